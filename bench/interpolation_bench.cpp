@@ -0,0 +1,135 @@
+// Copyright 2024 The Chris Poovey. All rights reserved.
+// Use of this source code is governed by the MIT License found in the License.md file.
+
+// Reports the cost and aliasing of each gf_interpolation mode. A sine is resampled at a non integer rate and the
+// output is fitted to the ideal sine at the read positions, whatever the fit leaves over is aliasing and imaging.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "gfInterpolation.h"
+
+namespace
+{
+	using namespace Grainflow;
+
+	constexpr double pi = 3.14159265358979323846;
+	constexpr int frames = 1 << 16;
+	constexpr int block = 256;
+	constexpr double frequencies[] = {0.02, 0.1, 0.2, 0.3, 0.4};
+
+	/// @brief The level in dB of what is left after fitting the output to the ideal sine, relative to the sine
+	template <gf_interpolation Mode>
+	double alias_level(const double frequency)
+	{
+		std::vector<double> source(frames);
+		for (int i = 0; i < frames; ++i)
+		{
+			source[i] = std::sin(2 * pi * frequency * i);
+		}
+		constexpr double rate = 0.7371;
+		constexpr int blocks = 100;
+		std::vector<double> positions(block);
+		std::vector<double> out(block);
+		std::vector<double> sampled;
+		std::vector<double> sines;
+		std::vector<double> cosines;
+		double position = 100.123;
+		for (int b = 0; b < blocks; ++b)
+		{
+			for (int i = 0; i < block; ++i)
+			{
+				positions[i] = position;
+				position += rate;
+			}
+			gf_interpolator::interpolate<Mode>(source.data(), 1, out.data(), positions.data(), block, 0, frames - 1,
+			                                   frames - 1);
+			for (int i = 0; i < block; ++i)
+			{
+				sampled.push_back(out[i]);
+				sines.push_back(std::sin(2 * pi * frequency * positions[i]));
+				cosines.push_back(std::cos(2 * pi * frequency * positions[i]));
+			}
+		}
+
+		double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0, power = 0;
+		for (size_t i = 0; i < sampled.size(); ++i)
+		{
+			ss += sines[i] * sines[i];
+			cc += cosines[i] * cosines[i];
+			sc += sines[i] * cosines[i];
+			ys += sampled[i] * sines[i];
+			yc += sampled[i] * cosines[i];
+			power += sines[i] * sines[i];
+		}
+		const double det = ss * cc - sc * sc;
+		const double a = (ys * cc - yc * sc) / det;
+		const double b = (yc * ss - ys * sc) / det;
+		double residual = 0;
+		for (size_t i = 0; i < sampled.size(); ++i)
+		{
+			const double r = sampled[i] - a * sines[i] - b * cosines[i];
+			residual += r * r;
+		}
+		return 10 * std::log10(residual / power);
+	}
+
+	/// @brief The average time to read one sample with positions advancing at a non integer rate
+	template <gf_interpolation Mode>
+	double ns_per_sample()
+	{
+		std::vector<double> source(frames);
+		for (int i = 0; i < frames; ++i)
+		{
+			source[i] = std::sin(i * 0.01);
+		}
+		std::vector<double> positions(block);
+		std::vector<double> out(block);
+		constexpr int blocks = 100000;
+		double position = 10;
+		double sink = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (int b = 0; b < blocks; ++b)
+		{
+			for (int i = 0; i < block; ++i)
+			{
+				positions[i] = position;
+				position += 1.37;
+				if (position > frames - 10) position -= frames - 20;
+			}
+			gf_interpolator::interpolate<Mode>(source.data(), 1, out.data(), positions.data(), block, 0, frames - 1,
+			                                   frames - 1);
+			sink += out[block / 2];
+		}
+		const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		// Keeps the reads from being optimized away
+		if (sink == 0.123456789) std::printf(" ");
+		return elapsed.count() / (static_cast<double>(blocks) * block);
+	}
+
+	template <gf_interpolation Mode>
+	void report(const char* name)
+	{
+		std::printf("%-8s %8.2f", name, ns_per_sample<Mode>());
+		for (const double frequency : frequencies)
+		{
+			std::printf(" %8.1f", alias_level<Mode>(frequency));
+		}
+		std::printf("\n");
+	}
+}
+
+int main()
+{
+	std::printf("%-8s %8s", "mode", "ns/smp");
+	for (const double frequency : frequencies)
+	{
+		std::printf("   f=%.2f", frequency);
+	}
+	std::printf("\n%-8s %8s %s\n", "", "", "alias level in dB for a sine at f cycles per frame, read at rate 0.7371");
+	report<gf_interpolation::linear>("linear");
+	report<gf_interpolation::hermite>("hermite");
+	report<gf_interpolation::sinc>("sinc");
+	return 0;
+}
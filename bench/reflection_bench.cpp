@@ -0,0 +1,191 @@
+// Copyright 2024 The Chris Poovey. All rights reserved.
+// Use of this source code is governed by the MIT License found in the License.md file.
+
+// Compares the reflection lookups in gfParam.h against the if/else chains they replaced. Each group of names is
+// resolved many times by both and the average time per lookup is reported.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "gfParam.h"
+
+namespace
+{
+	using namespace Grainflow;
+
+	// The chains param_reflection and buffer_reflection used before the perfect hash maps, kept as a reference
+	namespace chain
+	{
+		bool buffer_reflection(std::string reflectionString, gf_buffers& type)
+		{
+			if (reflectionString == "buf" || reflectionString == "buffer")
+			{
+				type = gf_buffers::buffer;
+			}
+			else if (reflectionString == "env" || reflectionString == "envelope")
+			{
+				type = gf_buffers::envelope;
+			}
+			else if (reflectionString == "delay" || reflectionString == "delays" || reflectionString == "delayBuffer")
+			{
+				type = gf_buffers::delay_buffer;
+			}
+			else if (reflectionString == "window" || reflectionString == "windows" ||
+				reflectionString == "windowBuffer")
+			{
+				type = gf_buffers::window_buffer;
+			}
+			else if (reflectionString == "glisson" || reflectionString == "glissonBuffer")
+			{
+				type = gf_buffers::glisson_buffer;
+			}
+			else if (reflectionString == "rate" || reflectionString == "rates" || reflectionString == "rateBuffer")
+			{
+				type = gf_buffers::rate_buffer;
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		}
+
+		bool param_reflection(std::string param, gf_param_name& out_param_name, gf_param_type& out_param_type)
+		{
+			out_param_type = gf_param_type::ERR;
+			if (const auto pos = param.find("Random"); pos != std::string::npos)
+			{
+				out_param_type = gf_param_type::random;
+				param.erase(pos, 6);
+			}
+			else if (const auto pos = param.find("Offset"); pos != std::string::npos)
+			{
+				out_param_type = gf_param_type::offset;
+				param.erase(pos, 6);
+			}
+			else if (const auto pos = param.find("Mode"); pos != std::string::npos)
+			{
+				out_param_type = gf_param_type::mode;
+				param.erase(pos, 4);
+			}
+			else out_param_type = gf_param_type::base;
+			if (out_param_type == gf_param_type::ERR) return false;
+
+			out_param_name = gf_param_name::ERR;
+			if (param == "delay") { out_param_name = gf_param_name::delay; }
+			else if (param == "rate") { out_param_name = gf_param_name::rate; }
+			else if (param == "window") { out_param_name = gf_param_name::window; }
+			else if (param == "rate") { out_param_name = gf_param_name::rate; }
+			else if (param == "amp") { out_param_name = gf_param_name::amplitude; }
+			else if (param == "space") { out_param_name = gf_param_name::space; }
+			else if (param == "envelopePosition") { out_param_name = gf_param_name::envelope_position; }
+			else if (param == "direction") { out_param_name = gf_param_name::direction; }
+			else if (param == "startPoint") { out_param_name = gf_param_name::start_point; }
+			else if (param == "stopPoint") { out_param_name = gf_param_name::stop_point; }
+			else if (param == "rateQuantizeSemi") { out_param_name = gf_param_name::rate_quantize_semi; }
+			else if (param == "loopMode") { out_param_name = gf_param_name::loop_mode; }
+			else if (param == "channel") { out_param_name = gf_param_name::channel; }
+			else if (param == "density") { out_param_name = gf_param_name::density; }
+			else if (param == "vibratoDepth") { out_param_name = gf_param_name::vibrato_depth; }
+			else if (param == "vibratoRate") { out_param_name = gf_param_name::vibrato_rate; }
+			else if (param == "transpose") { out_param_name = gf_param_name::transpose; }
+			else if (param == "glissonSt") { out_param_name = gf_param_name::glisson_st; }
+			else if (param == "stream") { out_param_name = gf_param_name::stream; }
+			else if (param == "nEnvelopes")
+			{
+				out_param_name = gf_param_name::n_envelopes;
+				out_param_type = gf_param_type::value;
+			}
+			return out_param_name != gf_param_name::ERR;
+		}
+	}
+
+	constexpr int repeats = 20000;
+	// Storing the results here keeps the lookups from being optimized away
+	volatile int sink = 0;
+
+	const std::vector<std::string> whole_names = {
+		"delay", "rate", "window", "amp", "space", "envelopePosition", "direction", "startPoint", "stopPoint",
+		"rateQuantizeSemi", "channel", "density", "vibratoDepth", "vibratoRate", "transpose", "glissonSt", "stream",
+		"nEnvelopes"
+	};
+	const std::vector<std::string> suffixed_names = {
+		"delayRandom", "rateRandom", "windowRandom", "ampRandom", "spaceRandom", "directionRandom", "densityRandom",
+		"delayOffset", "rateOffset", "windowOffset", "spaceOffset", "envelopePositionOffset", "channelMode",
+		"spaceMode", "vibratoRateRandom", "vibratoDepthOffset"
+	};
+	const std::vector<std::string> missing_names = {
+		"", "d", "rat", "windw", "ampl", "spaceRandomOffset", "Random", "densityMod", "vibrato", "startPointer",
+		"glisson", "notAParameterAtAll"
+	};
+	const std::vector<std::string> buffer_names = {
+		"buf", "buffer", "env", "envelope", "delay", "delays", "delayBuffer", "window", "windows", "windowBuffer",
+		"glisson", "glissonBuffer", "rate", "rates", "rateBuffer", "amp", "bufer", "notABuffer"
+	};
+
+	/// @brief The average time of one lookup over every name in names
+	template <typename Lookup>
+	double ns_per_lookup(const std::vector<std::string>& names, Lookup lookup)
+	{
+		// Reading the names through a volatile pointer keeps the lookups from being hoisted out of the loop
+		const std::string* volatile first = names.data();
+		int found = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			const std::string* name = first;
+			for (size_t i = 0; i < names.size(); ++i)
+			{
+				found += lookup(name[i]);
+			}
+		}
+		const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		sink = found;
+		return elapsed.count() / (static_cast<double>(repeats) * names.size());
+	}
+
+	void report_params(const char* group, const std::vector<std::string>& names)
+	{
+		const auto chain_ns = ns_per_lookup(names, [](const std::string& name)
+		{
+			gf_param_name param_name;
+			gf_param_type param_type;
+			if (!chain::param_reflection(name, param_name, param_type)) return 0;
+			return static_cast<int>(param_name) + static_cast<int>(param_type);
+		});
+		const auto map_ns = ns_per_lookup(names, [](const std::string& name)
+		{
+			gf_param_name param_name;
+			gf_param_type param_type;
+			if (!param_reflection(name, param_name, param_type)) return 0;
+			return static_cast<int>(param_name) + static_cast<int>(param_type);
+		});
+		std::printf("%-18s %6zu %10.1f %10.1f\n", group, names.size(), chain_ns, map_ns);
+	}
+
+	void report_buffers(const char* group, const std::vector<std::string>& names)
+	{
+		const auto chain_ns = ns_per_lookup(names, [](const std::string& name)
+		{
+			gf_buffers type;
+			return chain::buffer_reflection(name, type) ? static_cast<int>(type) + 1 : 0;
+		});
+		const auto map_ns = ns_per_lookup(names, [](const std::string& name)
+		{
+			gf_buffers type;
+			return buffer_reflection(name, type) ? static_cast<int>(type) + 1 : 0;
+		});
+		std::printf("%-18s %6zu %10.1f %10.1f\n", group, names.size(), chain_ns, map_ns);
+	}
+}
+
+int main()
+{
+	std::printf("%-18s %6s %10s %10s\n", "names", "count", "chain ns", "map ns");
+	report_params("param whole", whole_names);
+	report_params("param suffixed", suffixed_names);
+	report_params("param missing", missing_names);
+	report_buffers("buffer", buffer_names);
+	return 0;
+}
@@ -0,0 +1,267 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include "gfInterpolation.h"
+
+namespace Grainflow
+{
+	/// <summary>
+	/// Octave decimated copies of a buffer so grains played well above their original rate do not alias.
+	/// Level l holds every channel low pass filtered and decimated by 2^l, level 0 is the source buffer itself and is
+	/// not stored. sample() estimates the playback increment of a block from its positions and reads the two levels
+	/// either side of it, crossfaded by the fractional octave, so the cost per sample does not grow with the rate.
+	/// Building filters every level once and allocates, do it when the buffer is loaded or after recording into it
+	/// and never on the audio thread.
+	/// </summary>
+	template <typename T>
+	class gf_buffer_pyramid
+	{
+	public:
+		static constexpr int max_levels = 8;
+
+	private:
+		// Half of the odd taps of the halfband decimation filter, the even taps other than the centre are zero
+		static constexpr int half_taps = 8;
+		static constexpr double kaiser_beta = 8;
+		static constexpr int chunk = 64;
+
+		struct level
+		{
+			std::vector<T> samples;
+			int frames = 0;
+		};
+
+		// levels_[l - 1] is level l
+		std::vector<level> levels_;
+		int channels_ = 0;
+		std::atomic<bool> stale_{false};
+
+		/// @brief centre tap followed by the taps at offsets 1, 3, 5 ... of a Kaiser windowed halfband filter
+		static const std::array<double, half_taps + 1>& halfband()
+		{
+			static const std::array<double, half_taps + 1> taps = []
+			{
+				constexpr double pi = 3.14159265358979323846;
+				const double width = 2 * half_taps;
+				auto bessel_i0 = [](const double x)
+				{
+					double sum = 1;
+					double term = 1;
+					for (int k = 1; k < 32; ++k)
+					{
+						term *= (x / (2 * k)) * (x / (2 * k));
+						sum += term;
+					}
+					return sum;
+				};
+				std::array<double, half_taps + 1> result{};
+				double sum = 0.5;
+				result[0] = 0.5;
+				for (int k = 1; k <= half_taps; ++k)
+				{
+					const int offset = 2 * k - 1;
+					const double ratio = offset / width;
+					const double window = bessel_i0(kaiser_beta * std::sqrt(1 - ratio * ratio));
+					result[k] = std::sin(pi * offset / 2) / (pi * offset) * window / bessel_i0(kaiser_beta);
+					sum += 2 * result[k];
+				}
+				for (auto& tap : result)
+				{
+					tap /= sum;
+				}
+				return result;
+			}();
+			return taps;
+		}
+
+		/// @brief Filters and decimates one channel by two, the source is treated as a loop
+		static void decimate(const T* __restrict source, const int source_frames, T* __restrict target,
+		                     const int target_frames)
+		{
+			const auto& taps = halfband();
+			const int reach = 2 * half_taps - 1;
+			for (int j = 0; j < target_frames; ++j)
+			{
+				const int centre = 2 * j;
+				double sum = taps[0] * source[centre % source_frames];
+				if (centre >= reach && centre + reach < source_frames)
+				{
+					for (int k = 1; k <= half_taps; ++k)
+					{
+						const int offset = 2 * k - 1;
+						sum += taps[k] * (source[centre - offset] + source[centre + offset]);
+					}
+				}
+				else
+				{
+					for (int k = 1; k <= half_taps; ++k)
+					{
+						const int offset = 2 * k - 1;
+						const int before = ((centre - offset) % source_frames + source_frames) % source_frames;
+						const int after = (centre + offset) % source_frames;
+						sum += taps[k] * (source[before] + source[after]);
+					}
+				}
+				target[j] = static_cast<T>(sum);
+			}
+		}
+
+	public:
+		gf_buffer_pyramid() = default;
+
+		gf_buffer_pyramid(gf_buffer_pyramid&& other) noexcept : levels_(std::move(other.levels_)),
+		                                                        channels_(other.channels_),
+		                                                        stale_(other.stale_.load())
+		{
+		}
+
+		gf_buffer_pyramid& operator=(gf_buffer_pyramid&& other) noexcept
+		{
+			levels_ = std::move(other.levels_);
+			channels_ = other.channels_;
+			stale_.store(other.stale_.load());
+			return *this;
+		}
+
+		/// @brief Builds levels 1 to levels from planar channels, levels is limited by max_levels and by the length
+		/// of the buffer
+		void build(const T* const* channels, const int n_channels, const int frames, const int levels)
+		{
+			levels_.clear();
+			channels_ = std::max(n_channels, 0);
+			stale_.store(false);
+			const T* const* source = channels;
+			std::vector<const T*> level_channels(channels_);
+			int source_frames = frames;
+			for (int l = 1; l <= std::min(levels, max_levels); ++l)
+			{
+				if (source_frames < 2 * (2 * half_taps)) break;
+				level next;
+				next.frames = (source_frames + 1) / 2;
+				next.samples.resize(static_cast<size_t>(next.frames) * channels_);
+				for (int c = 0; c < channels_; ++c)
+				{
+					decimate(source[c], source_frames, &next.samples[static_cast<size_t>(c) * next.frames],
+					         next.frames);
+				}
+				levels_.push_back(std::move(next));
+				for (int c = 0; c < channels_; ++c)
+				{
+					level_channels[c] = &levels_.back().samples[static_cast<size_t>(c) * levels_.back().frames];
+				}
+				source = level_channels.data();
+				source_frames = levels_.back().frames;
+			}
+		}
+
+		void clear()
+		{
+			levels_.clear();
+			stale_.store(false);
+		}
+
+		/// @brief The number of decimated levels, 0 when the pyramid is empty
+		[[nodiscard]] int levels() const
+		{
+			return static_cast<int>(levels_.size());
+		}
+
+		/// @brief Marks the levels as out of date after the source was written, sample() then reads the source only
+		/// until the next build
+		void invalidate()
+		{
+			stale_.store(true, std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] bool stale() const
+		{
+			return stale_.load(std::memory_order_relaxed);
+		}
+
+		/// @brief The average distance between neighbouring positions, ignoring jumps across the loop
+		static T playback_increment(const T* __restrict positions, const int size, const int lower_frame,
+		                            const int upper_frame)
+		{
+			if (size < 2) return 1;
+			const T jump = static_cast<T>(std::max(std::abs(upper_frame - lower_frame), 2)) / 2;
+			T sum = 0;
+			int count = 0;
+			for (int i = 1; i < size; ++i)
+			{
+				const T step = std::abs(positions[i] - positions[i - 1]);
+				const bool in_loop = step < jump;
+				sum += step * in_loop;
+				count += in_loop;
+			}
+			return count > 0 ? sum / count : 1;
+		}
+
+		/// <summary>
+		/// Reads a channel at frame positions of the source. Increments up to 1 read the source alone, above that the
+		/// levels either side of log2(increment) are read and crossfaded. Increments beyond the top level read it
+		/// alone. source_guard is the guard of the source, see gf_interpolator::interpolate.
+		/// </summary>
+		template <gf_interpolation Mode>
+		void sample(const T* source, const int source_frames, const int source_guard, const int channel,
+		            T* __restrict out, const T* __restrict positions, const int size, const int lower_frame,
+		            const int upper_frame) const
+		{
+			double octave = 0;
+			if (!levels_.empty() && !stale() && channel < channels_)
+			{
+				const auto increment = playback_increment(positions, size, lower_frame, upper_frame);
+				if (increment > 1) octave = std::log2(static_cast<double>(increment));
+			}
+			if (octave <= 0)
+			{
+				gf_interpolator::interpolate<Mode>(source, 1, out, positions, size, lower_frame, upper_frame,
+				                                   source_frames - 1, source_guard);
+				return;
+			}
+			const int first_level = std::min(static_cast<int>(octave), levels());
+			const auto fade = static_cast<T>(first_level < levels() ? octave - first_level : 0);
+			alignas(32) T scaled[chunk];
+			alignas(32) T faded[chunk];
+			for (int begin = 0; begin < size; begin += chunk)
+			{
+				const int count = std::min(chunk, size - begin);
+				read_level<Mode>(first_level, source, source_frames, source_guard, channel, out + begin,
+				                 positions + begin, scaled, count, lower_frame, upper_frame);
+				if (fade <= 0) continue;
+				read_level<Mode>(first_level + 1, source, source_frames, source_guard, channel, faded,
+				                 positions + begin, scaled, count, lower_frame, upper_frame);
+				T* __restrict block = out + begin;
+				for (int i = 0; i < count; ++i)
+				{
+					block[i] = block[i] * (1 - fade) + faded[i] * fade;
+				}
+			}
+		}
+
+	private:
+		template <gf_interpolation Mode>
+		void read_level(const int level_index, const T* source, const int source_frames, const int source_guard,
+		                const int channel, T* __restrict out, const T* __restrict positions, T* __restrict scaled,
+		                const int size, const int lower_frame, const int upper_frame) const
+		{
+			if (level_index == 0)
+			{
+				gf_interpolator::interpolate<Mode>(source, 1, out, positions, size, lower_frame, upper_frame,
+				                                   source_frames - 1, source_guard);
+				return;
+			}
+			const auto& level = levels_[level_index - 1];
+			const T scale = static_cast<T>(1) / static_cast<T>(1 << level_index);
+			for (int i = 0; i < size; ++i)
+			{
+				scaled[i] = positions[i] * scale;
+			}
+			gf_interpolator::interpolate<Mode>(&level.samples[static_cast<size_t>(channel) * level.frames], 1, out,
+			                                   scaled, size, lower_frame >> level_index, upper_frame >> level_index,
+			                                   level.frames - 1);
+		}
+	};
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <new>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+namespace Grainflow
+{
+	/// <summary>
+	/// Sample storage for a buffer in one aligned allocation. Channels are planar and each channel starts on a cache
+	/// line. guard frames sit before the first and after the last frame of every channel and hold copies of the frames
+	/// at the other end, so a reader that loops the whole buffer can read up to guard frames past either end without
+	/// wrapping. Writes through write() keep the guards current, code writing through channel() directly calls
+	/// update_guards() afterwards.
+	/// </summary>
+	template <typename T>
+	class gf_buffer_storage
+	{
+	public:
+		static constexpr size_t alignment = 64;
+		static constexpr int guard = 16;
+
+	private:
+		struct aligned_delete
+		{
+			void operator()(T* samples) const
+			{
+				::operator delete[](samples, std::align_val_t{alignment});
+			}
+		};
+
+		std::unique_ptr<T[], aligned_delete> samples_;
+		int frames_ = 0;
+		int channels_ = 0;
+		size_t channel_stride_ = 0;
+
+		static size_t stride_for(const int frames)
+		{
+			constexpr size_t line = alignment / sizeof(T);
+			const size_t padded = static_cast<size_t>(frames) + 2 * guard;
+			return (padded + line - 1) / line * line;
+		}
+
+		void update_guards(const int channel)
+		{
+			if (frames_ <= 0) return;
+			T* samples = this->channel(channel);
+			for (int i = 1; i <= guard; ++i)
+			{
+				samples[-i] = samples[frames_ - 1 - (i - 1) % frames_];
+			}
+			for (int i = 0; i < guard; ++i)
+			{
+				samples[frames_ + i] = samples[i % frames_];
+			}
+		}
+
+	public:
+		gf_buffer_storage() = default;
+
+		gf_buffer_storage(const int frames, const int channels)
+		{
+			resize(frames, channels);
+		}
+
+		/// @brief Reallocates for frames and channels, samples that fit in the new size are kept and the rest are
+		/// zero. Allocates, call it outside of the audio thread.
+		void resize(const int frames, const int channels)
+		{
+			const int new_frames = std::max(frames, 0);
+			const int new_channels = std::max(channels, 0);
+			const size_t stride = stride_for(new_frames);
+			const size_t size = stride * new_channels;
+			std::unique_ptr<T[], aligned_delete> samples(
+				size > 0 ? static_cast<T*>(::operator new[](size * sizeof(T), std::align_val_t{alignment})) : nullptr);
+			std::fill_n(samples.get(), size, static_cast<T>(0));
+			const int kept_frames = std::min(new_frames, frames_);
+			for (int c = 0; c < std::min(new_channels, channels_); ++c)
+			{
+				std::copy_n(channel(c), kept_frames, samples.get() + stride * c + guard);
+			}
+			samples_ = std::move(samples);
+			frames_ = new_frames;
+			channels_ = new_channels;
+			channel_stride_ = stride;
+			update_guards();
+		}
+
+		[[nodiscard]] int frames() const
+		{
+			return frames_;
+		}
+
+		[[nodiscard]] int channels() const
+		{
+			return channels_;
+		}
+
+		/// @brief The first frame of a channel, frames [-guard, frames + guard) can be read
+		inline T* channel(const int channel)
+		{
+			return samples_.get() + channel_stride_ * channel + guard;
+		}
+
+		inline const T* channel(const int channel) const
+		{
+			return samples_.get() + channel_stride_ * channel + guard;
+		}
+
+		inline T& lookup(const int frame, const int channel)
+		{
+			return this->channel(channel)[frame];
+		}
+
+		void fill(const T value)
+		{
+			std::fill_n(samples_.get(), channel_stride_ * channels_, value);
+		}
+
+		/// @brief Refreshes the guard frames of every channel
+		void update_guards()
+		{
+			for (int c = 0; c < channels_; ++c)
+			{
+				update_guards(c);
+			}
+		}
+
+		/// @brief Copies size frames into a channel starting at start, frames past the end continue from frame 0
+		void write(const int channel, const T* samples, const int start, const int size)
+		{
+			if (frames_ <= 0 || size <= 0) return;
+			T* target = this->channel(channel);
+			const int first = (start % frames_ + frames_) % frames_;
+			int frame = first;
+			int written = 0;
+			while (written < size)
+			{
+				const int count = std::min(size - written, frames_ - frame);
+				std::copy_n(samples + written, count, target + frame);
+				written += count;
+				frame = 0;
+			}
+			if (first < guard || first + size > frames_ - guard) update_guards(channel);
+		}
+
+		/// @brief Copies size frames of a channel starting at start into samples, frames past the end continue from
+		/// frame 0
+		void read(const int channel, T* samples, const int start, const int size) const
+		{
+			if (frames_ <= 0 || size <= 0) return;
+			const T* source = this->channel(channel);
+			int frame = (start % frames_ + frames_) % frames_;
+			int done = 0;
+			while (done < size)
+			{
+				const int count = std::min(size - done, frames_ - frame);
+				std::copy_n(source + frame, count, samples + done);
+				done += count;
+				frame = 0;
+			}
+		}
+	};
+}
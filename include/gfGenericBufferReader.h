@@ -1,77 +1,241 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "gfIBufferReader.h"
+#include "gfBufferPyramid.h"
+#include "gfBufferStorage.h"
 #include "gfParam.h"
 #include <../lib/AudioFile/AudioFile.h>
 
 namespace Grainflow{
+    /// <summary>
+    /// The storage, pyramid and samplerate of a gf_buffer at one point in time. A snapshot is published once and its
+    /// shape never changes afterwards, replacing or resizing the buffer publishes a new one. Samples are still written
+    /// in place, recording into a buffer does not allocate.
+    /// </summary>
+    template<typename SigType>
+    struct gf_buffer_snapshot{
+        std::shared_ptr<gf_buffer_storage<SigType>> storage;
+        std::shared_ptr<gf_buffer_pyramid<SigType>> pyramid;
+        int samplerate = 0;
+    };
+
+    template<typename SigType>
+    struct buffer_read_lock;
+
+    /// <summary>
+    /// A buffer of planar samples in a gf_buffer_storage. Files are decoded with AudioFile and copied in. Code that
+    /// writes through channel() calls update_guards() afterwards.
+    /// Readers enter a buffer_read_lock, which never waits and never fails. replace(), resize(), set_pyramid_levels()
+    /// and build_pyramid() build a new snapshot, publish it with one atomic exchange and free the old one once every
+    /// reader that could have seen it has left. Two reader counts alternate between epochs so a writer only waits for
+    /// readers that entered before its swap. Writers allocate and may wait, call them outside of the audio thread.
+    /// The host owns every gf_buffer. Grains and collections only hold pointers to them, so a buffer must outlive
+    /// the grains reading it and is never deleted by them.
+    /// </summary>
     template<typename SigType>
     class gf_buffer{
-        public:
-        std::atomic<bool> latch_;
-        std::unique_ptr<AudioFile<SigType>> data_;
+        friend struct buffer_read_lock<SigType>;
 
         private:
+        std::atomic<gf_buffer_snapshot<SigType>*> current_{nullptr};
+        std::atomic<unsigned> epoch_{0};
+        std::atomic<int> readers_[2]{{0}, {0}};
+        std::mutex write_mutex_;
+        int pyramid_levels_ = 0;
+
+        /// @brief Registers a reader with the current epoch and returns the snapshot it may read until exit()
+        gf_buffer_snapshot<SigType>* enter(unsigned& slot){
+            while (true){
+                const unsigned epoch = epoch_.load();
+                slot = epoch & 1;
+                readers_[slot].fetch_add(1);
+                if (epoch_.load() == epoch){
+                    return current_.load();
+                }
+                // A writer flipped the epoch in between and may already be waiting on this count
+                readers_[slot].fetch_sub(1);
+            }
+        }
 
+        void exit(const unsigned slot){
+            readers_[slot].fetch_sub(1, std::memory_order_release);
+        }
 
-        void clear(){
-            for (auto& c : data_->samples){
-                std::fill(c.begin(), c.end(), 0);
+        /// @brief Swaps in next and frees the previous snapshot after the readers of the previous epoch have left.
+        /// Called with write_mutex_ held.
+        void publish(gf_buffer_snapshot<SigType>* next){
+            gf_buffer_snapshot<SigType>* previous = current_.exchange(next);
+            const unsigned epoch = epoch_.fetch_add(1);
+            while (readers_[epoch & 1].load(std::memory_order_acquire) != 0){
+                std::this_thread::yield();
             }
+            delete previous;
         }
 
-        void replace(std::string& file_path){
-            data_->load(file_path);
+        std::shared_ptr<gf_buffer_pyramid<SigType>> make_pyramid(const gf_buffer_storage<SigType>& storage) const{
+            auto pyramid = std::make_shared<gf_buffer_pyramid<SigType>>();
+            if (pyramid_levels_ <= 0){
+                return pyramid;
+            }
+            std::vector<const SigType*> channels;
+            for (int c = 0; c < storage.channels(); ++c){
+                channels.push_back(storage.channel(c));
+            }
+            pyramid->build(channels.data(), storage.channels(), storage.frames(), pyramid_levels_);
+            return pyramid;
+        }
+
+        /// @brief Publishes the current samples with a pyramid rebuilt from them. Called with write_mutex_ held.
+        void publish_pyramid(){
+            const gf_buffer_snapshot<SigType>* current = current_.load();
+            publish(new gf_buffer_snapshot<SigType>{current->storage, make_pyramid(*current->storage),
+                                                    current->samplerate});
         }
 
         public:
-		gf_buffer(){
-			data_ = std::make_unique<AudioFile<SigType>>();
+		gf_buffer() : current_(new gf_buffer_snapshot<SigType>{std::make_shared<gf_buffer_storage<SigType>>(),
+		                                                       std::make_shared<gf_buffer_pyramid<SigType>>(), 0}){
 		}
-        gf_buffer(int frames, int channels, int samplerate){
-            data_ = std::make_unique<AudioFile<SigType>>();
-            data_->setAudioBufferSize(channels, frames);
-            data_->setSampleRate(samplerate);
+        gf_buffer(int frames, int channels, int samplerate)
+            : current_(new gf_buffer_snapshot<SigType>{std::make_shared<gf_buffer_storage<SigType>>(frames, channels),
+                                                       std::make_shared<gf_buffer_pyramid<SigType>>(), samplerate}){
+        }
+        gf_buffer(std::string& file_path, int pyramid_levels = 0) : gf_buffer(){
+            pyramid_levels_ = std::clamp(pyramid_levels, 0, gf_buffer_pyramid<SigType>::max_levels);
+			replace(file_path);
         }
-        gf_buffer(std::string& file_path){
-            data_ = std::make_unique<AudioFile<SigType>>();
-			data_->load(file_path);
+        /// @brief No reader may be inside the buffer when it is destroyed, remove it from every grain first
+        ~gf_buffer(){
+            delete current_.load();
+        }
+
+        /// @brief Loads an audio file and publishes it with its pyramid. The current samples stay in place when the
+        /// file cannot be loaded.
+        void replace(const std::string& file_path){
+            AudioFile<SigType> file;
+            if (!file.load(file_path)) return;
+            const int frames = file.getNumSamplesPerChannel();
+            const int channels = file.getNumChannels();
+            auto storage = std::make_shared<gf_buffer_storage<SigType>>(frames, channels);
+            for (int c = 0; c < channels; ++c){
+                std::copy_n(file.samples[c].data(), frames, storage->channel(c));
+            }
+            storage->update_guards();
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            auto pyramid = make_pyramid(*storage);
+            publish(new gf_buffer_snapshot<SigType>{std::move(storage), std::move(pyramid),
+                                                    static_cast<int>(file.getSampleRate())});
         }
+
+        /// @brief Publishes a buffer of frames and channels, samples that fit in the new size are kept
 		void resize(int frames, int channels, int samplerate = 0){
-            data_->setAudioBufferSize(channels, frames);
-            data_->setSampleRate(samplerate);
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const gf_buffer_storage<SigType>& current = *current_.load()->storage;
+            auto storage = std::make_shared<gf_buffer_storage<SigType>>(frames, channels);
+            const int kept_frames = std::min(storage->frames(), current.frames());
+            for (int c = 0; c < std::min(storage->channels(), current.channels()); ++c){
+                std::copy_n(current.channel(c), kept_frames, storage->channel(c));
+            }
+            storage->update_guards();
+            auto pyramid = make_pyramid(*storage);
+            publish(new gf_buffer_snapshot<SigType>{std::move(storage), std::move(pyramid), samplerate});
+        }
+
+        /// @brief Zeroes every sample in place, safe to call while grains are reading
+        void clear(){
+            unsigned slot;
+            const gf_buffer_snapshot<SigType>* snapshot = enter(slot);
+            snapshot->storage->fill(0);
+            snapshot->pyramid->invalidate();
+            exit(slot);
+        }
+
+        // The accessors below read the current snapshot without entering it. They are meant for the thread that
+        // replaces or resizes the buffer, other threads read through a buffer_read_lock.
+
+        [[nodiscard]] int frames() const{
+            return current_.load()->storage->frames();
+        }
+
+        [[nodiscard]] int channels() const{
+            return current_.load()->storage->channels();
+        }
+
+        [[nodiscard]] int samplerate() const{
+            return current_.load()->samplerate;
+        }
+
+        /// @brief The first frame of a channel
+        SigType* channel(int channel){
+            return current_.load()->storage->channel(channel);
+        }
+
+        /// @brief Copies the first and last frames of every channel into the guards after writing through channel()
+        void update_guards(){
+            current_.load()->storage->update_guards();
+        }
+
+        gf_buffer_storage<SigType>& storage(){
+            return *current_.load()->storage;
+        }
+
+        /// @brief Keeps up to levels octave decimated copies of the buffer for grains played above their original
+        /// rate, 0 turns them off. Builds the copies, so call it outside of the audio thread.
+        void set_pyramid_levels(int levels){
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            pyramid_levels_ = std::clamp(levels, 0, gf_buffer_pyramid<SigType>::max_levels);
+            publish_pyramid();
+        }
+
+        /// @brief Rebuilds the decimated copies from the samples. Writing to the buffer leaves grains reading the
+        /// full rate samples only, call this once recording into it stops. Do not call it on the audio thread.
+        void build_pyramid(){
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            publish_pyramid();
+        }
+
+        gf_buffer_pyramid<SigType>& pyramid(){
+            return *current_.load()->pyramid;
         }
 
     };
+    /// <summary>
+    /// Reads the snapshot of a gf_buffer that was current when the lock was taken. Any number of readers can hold
+    /// one at the same time and taking it never blocks, a replace() or resize() during the read only takes effect
+    /// for the next lock. Do not replace or resize the buffer while holding one on the same thread.
+    /// </summary>
     template<typename SigType>
-    struct buffer_lock{ 
+    struct buffer_read_lock{ 
         private:
-        SigType dummy_;
         gf_buffer<SigType>* buffer_ {nullptr};
-        bool valid_ {false};
+        gf_buffer_snapshot<SigType>* snapshot_ {nullptr};
+        unsigned slot_ {0};
         public:
-        buffer_lock(gf_buffer<SigType>* buffer){
+        buffer_read_lock(gf_buffer<SigType>* buffer){
             buffer_ = buffer;
-            if (buffer_->latch_.load()){
-                return;
-            }
-            buffer_->latch_.store(true);
-            valid_ = true;
+            snapshot_ = buffer_->enter(slot_);
         }
-        ~buffer_lock(){
-			 buffer_->latch_.store(false);
+        ~buffer_read_lock(){
+			 buffer_->exit(slot_);
 		};
+        buffer_read_lock(const buffer_read_lock&) = delete;
+        buffer_read_lock& operator=(const buffer_read_lock&) = delete;
+
         bool valid(){
-            return valid_;
+            return snapshot_ != nullptr;
         }
 
-        bool clear(){
-            buffer_->clear();
+        SigType* channel(int channel){
+             return snapshot_->storage->channel(channel);
         }
 
-        std::vector<std::vector<SigType>>& get_samples(){
-             return buffer_->data_->samples;
+        gf_buffer_storage<SigType>& storage(){
+             return *snapshot_->storage;
         }
 
         void get_info(gf_buffer_info* info){
@@ -82,33 +246,32 @@ namespace Grainflow{
             info->one_over_samplerate = 1/info->samplerate;
         }
 
-        void replace(std::string audio_file_path){
-            buffer_->replace(audio_file_path);
-        }
-
-        void resize(int frames, int channels, int samplerate = 0){
-            buffer_->resize(frames, channels, samplerate);
-        }
-
-
         int frame_count(){
-            return buffer_->data_->getNumSamplesPerChannel();
+            return snapshot_->storage->frames();
         }
 
         int channel_count(){
-            return buffer_->data_->getNumChannels();
+            return snapshot_->storage->channels();
         }
 
         int samplerate(){
-            return buffer_->data_->getSampleRate();
+            return snapshot_->samplerate;
         }
 
         inline SigType& lookup(int frame, int channel){
-            return buffer_->data_->samples[channel][frame];
+            return snapshot_->storage->lookup(frame, channel);
+        }
+
+        gf_buffer_pyramid<SigType>& pyramid(){
+            return *snapshot_->pyramid;
         }
 
     };
-    template<typename SigType>
+    /// <summary>
+    /// Reads gf_buffer objects for grains. Interpolation picks the kernel sample_buffer uses, so a collection chooses
+    /// its quality through its reader type.
+    /// </summary>
+    template<typename SigType, gf_interpolation Interpolation = gf_interpolation::linear>
     class gf_buffer_reader{
         public:
 		static bool update_buffer_info(gf_buffer<SigType>* buffer, const gf_io_config<SigType>& io_config,
@@ -117,25 +280,25 @@ namespace Grainflow{
 			if (buffer == nullptr){
                 return false;
             }
-			buffer_lock<SigType> buffer_lock(buffer);
-            if (!buffer_lock.valid()){
+			buffer_read_lock<SigType> info_lock(buffer);
+            if (!info_lock.valid()){
                 return false;
             }
 
-            buffer_lock.get_info(buffer_info);
+            info_lock.get_info(buffer_info);
             buffer_info->sample_rate_adjustment = buffer_info->samplerate / io_config.samplerate;
             
 			return true;
 		}
 
-		static bool sample_param_buffer(gf_buffer<SigType>* buffer, gf_param* param, const int grain_id)
+		static bool sample_param_buffer(gf_buffer<SigType>* buffer, gf_param* param, const int grain_id, gf_rng& rng)
 		{
 			
 			if (param->mode == gf_buffer_mode::normal || buffer == nullptr)
 			{
 				return false;
 			}
-			buffer_lock<SigType> param_buf(buffer);
+			buffer_read_lock<SigType> param_buf(buffer);
 			if (!param_buf.valid())
 				return false;
 			size_t frame = 0;
@@ -147,9 +310,9 @@ namespace Grainflow{
 			}
 			else if (param->mode == gf_buffer_mode::buffer_random)
 			{
-				frame = (rand() % frames);
+				frame = rng.below(static_cast<std::uint32_t>(frames));
 			}
-			param->value = param_buf.lookup(frame, 0) + param->random * (rand() % 10000) * 0.0001 + param->offset *
+			param->value = param_buf.lookup(frame, 0) + param->random * rng.uniform() + param->offset *
 				grain_id;
 			return true;
 		}
@@ -158,7 +321,7 @@ namespace Grainflow{
 		                          const SigType* positions, 
 		                          const int size, const float lower_bound, const float upper_bound)
 		{
-			buffer_lock<SigType> sample_lock(buffer);
+			buffer_read_lock<SigType> sample_lock(buffer);
             if (!sample_lock.valid()){
                 return;
             }
@@ -171,81 +334,46 @@ namespace Grainflow{
 			int channels = static_cast<int>(sample_lock.channel_count());
 			channels = std::max(channels, 1);
 			const auto chan = channel % channels;
-			for (int i = 0; i < size; i++)
-			{
-				const auto position = positions[i];
-				const auto first_frame = static_cast<int>(position);
-				const auto tween = position - first_frame;
-				const bool frame_overflow = first_frame >= upper_frame;
-				const int second_frame = (first_frame + 1) * !frame_overflow + lower_frame * frame_overflow;
-				samples[i] = sample_lock.lookup(first_frame, chan) * (1 - tween) + sample_lock.lookup(second_frame, chan)* tween;
-			}
+			sample_lock.pyramid().template sample<Interpolation>(sample_lock.channel(chan), max_frame + 1,
+			                                                     gf_buffer_storage<SigType>::guard, chan, samples,
+			                                                     positions, size, lower_frame, upper_frame);
 
 		}
 
 		static void read_buffer(gf_buffer<SigType>* buffer, int channel, SigType* __restrict samples, int start_sample,
 			const int size)
 		{
-			buffer_lock<SigType> sample_lock(buffer);
+			buffer_read_lock<SigType> sample_lock(buffer);
             if (!sample_lock.valid()){
                 return;
             }
-            auto& buffer_samples = sample_lock.get_samples();
-
-            const int frames = static_cast<int>(sample_lock.frame_count());
 			int channels = static_cast<int>(sample_lock.channel_count());
 			if (channels <= 0) return;
-			auto write_channel = channel % channels;
-			auto is_segmented = (start_sample + size) >= frames;
-
-			if (!is_segmented)
-			{
-				for (int i = 0; i < size; i++)
-				{
-					samples[i] = buffer_samples[channel][(start_sample + i)];
-				}
-			}
-			else
-			{
-				for (int i = 0; i < size; i++)
-				{
-					samples[i] = buffer_samples[channel][(((start_sample + i) % frames))];
-				}
-			}
-			
+			sample_lock.storage().read(channel % channels, samples, start_sample, size);
 		}
 
 		static void write_buffer(gf_buffer<SigType>* buffer, const int channel, const SigType* samples,
 			const int start_position, const int size)
 		{
-			buffer_lock<SigType> sample_lock(buffer);
+			buffer_read_lock<SigType> sample_lock(buffer);
             if (!sample_lock.valid()){
                 return;
             }
 
-            auto& buffer_samples = sample_lock.get_samples();
             const int frames = static_cast<int>(sample_lock.frame_count());
 			int channels = static_cast<int>(sample_lock.channel_count());
 			if (channels <= 0 || frames <= 0) return;
-			auto write_channel = channel % channels;
-			auto is_segmented = (start_position + size) >= frames;
-
-			if (!is_segmented)
-			{
-				for (int i = 0; i < size; i++)
-				{
-					buffer_samples[channel][(start_position + i)] = samples[i];
-				}
-				return;
-			}
-			auto first_chunk = (start_position + size) - frames;
-			for (int i = 0; i < size; i++)
-			{
-				buffer_samples[channel][(((start_position + i) % frames))] = samples[i];
-			}            
+			sample_lock.pyramid().invalidate();
+			sample_lock.storage().write(channel % channels, samples, start_position, size);
 		}
 
 
+		static void clear_buffer(gf_buffer<SigType>* buffer)
+		{
+			if (buffer == nullptr) return;
+			buffer->clear();
+		}
+
 		static void sample_envelope(gf_buffer<SigType>* buffer, const bool use_default, const int n_envelopes,
 		                            const float env2d_pos, SigType* __restrict samples,
 		                            const SigType* __restrict grain_clock, const int size)
@@ -261,32 +389,30 @@ namespace Grainflow{
 				return;
 			}
 
-			buffer_lock<SigType> sample_lock(buffer);
+			buffer_read_lock<SigType> sample_lock(buffer);
             if (!sample_lock.valid()){
                 return;
             }
-            auto& buffer_samples = sample_lock.get_samples();
+            const SigType* envelope = sample_lock.channel(0);
 			int frames = sample_lock.frame_count();
 
             if (n_envelopes <= 1)
 			{
 				for (int i = 0; i < size; i++)
 				{
-					if (!sample_lock.valid()) return;
 					const auto frame = static_cast<int>(grain_clock[i] * frames);
-					samples[i] = buffer_samples[0][frame];
+					samples[i] = envelope[frame];
 				}
 				return;
 			}
 			for (int i = 0; i < size; i++)
 			{
-				if (!sample_lock.valid()) return;
 				const int size_per_envelope = frames / n_envelopes;
 				const int env1 = static_cast<int>(env2d_pos * static_cast<float>(n_envelopes));
 				const int env2 = env1 + 1;
 				const float fade = env2d_pos * static_cast<float>(n_envelopes) - static_cast<float>(env1);
 				const auto frame = static_cast<int>((grain_clock[i] * size_per_envelope));
-				samples[i] = buffer_samples[0][(env1 * size_per_envelope + frame) % frames] * (1 - fade) + buffer_samples[0][(
+				samples[i] = envelope[(env1 * size_per_envelope + frame) % frames] * (1 - fade) + envelope[(
 					env2 *
 					size_per_envelope + frame) % frames] * fade;
 			}
@@ -297,12 +423,13 @@ namespace Grainflow{
 		static gf_i_buffer_reader<gf_buffer<SigType>, SigType> get_gf_buffer_reader()
 		{
 			gf_i_buffer_reader<gf_buffer<SigType>, SigType> _bufferReader;
-			_bufferReader.sample_buffer = gf_buffer_reader<SigType>::sample_buffer;
-			_bufferReader.sample_envelope = gf_buffer_reader<SigType>::sample_envelope;
-			_bufferReader.update_buffer_info = gf_buffer_reader<SigType>::update_buffer_info;
-			_bufferReader.sample_param_buffer = gf_buffer_reader<SigType>::sample_param_buffer;
-			_bufferReader.write_buffer = gf_buffer_reader<SigType>::write_buffer;
-			_bufferReader.read_buffer = gf_buffer_reader<SigType>::read_buffer;
+			_bufferReader.sample_buffer = gf_buffer_reader::sample_buffer;
+			_bufferReader.sample_envelope = gf_buffer_reader::sample_envelope;
+			_bufferReader.update_buffer_info = gf_buffer_reader::update_buffer_info;
+			_bufferReader.sample_param_buffer = gf_buffer_reader::sample_param_buffer;
+			_bufferReader.write_buffer = gf_buffer_reader::write_buffer;
+			_bufferReader.read_buffer = gf_buffer_reader::read_buffer;
+			_bufferReader.clear_buffer = gf_buffer_reader::clear_buffer;
 			return _bufferReader;
 		}
         
@@ -1,6 +1,5 @@
 #pragma once
 #include <memory>
-#include <random>
 #include <algorithm>
 #include <numeric>
 #include <atomic>
@@ -9,6 +8,8 @@
 #include "gfIBufferReader.h"
 #include "gfIoConfig.h"
 #include "gfSyn.h"
+#include "gfKernels.h"
+#include "gfRandom.h"
 
 /// <summary>
 /// Contains entries and functions that modify said entities. This is the
@@ -22,11 +23,19 @@ namespace Grainflow
 	/// -SampleParamBuffer
 	/// -SampleEnvelope
 	/// -SampleParamBuffer
+	/// Reader supplies those calls. The default gf_i_buffer_reader holds function pointers so hosts such as Max and
+	/// PD can bind their own buffers at runtime. Any type with the same members callable with the same arguments,
+	/// such as gf_buffer_reader, is called directly and can be inlined into the grain loop.
 	/// </summary>
-	template <typename T, size_t Blocksize, typename SigType = double>
+	template <typename T, size_t Blocksize, typename SigType = double,
+	          typename Reader = gf_i_buffer_reader<T, SigType>>
 	class gf_grain
 	{
 		static_assert(std::atomic<bool>::is_always_lock_free, "Atomic<bool> must be lock free");
+		static constexpr int n_params = static_cast<int>(gf_param_name::vibrato_depth);
+
+		template <typename, size_t, typename, typename>
+		friend class gf_grain;
 
 	private:
 		static constexpr SigType Grainclock_Thresh = 1e-7;
@@ -37,19 +46,22 @@ namespace Grainflow
 		bool buffer_defined_ = false;
 		gf_value_table value_table_[2];
 		SigType sample_id_temp_[Blocksize];
-		float density_temp_[Blocksize];
-		float amp_temp_[Blocksize];
 		SigType temp_sigtype_[Blocksize];
 		SigType glisson_temp_[Blocksize];
 		std::unique_ptr<Grainflow::phasor<SigType, Blocksize>> vibrato_phasor_;
 		bool reset_pending_;
 		int g_ = 0;
 		bool enabled_internal_ = false;
-		bool window_changed_;
+		bool window_changed_ = false;
 		size_t stream_ = 0;
+		// Sample of the last internal block where the grain last reset, -1 when it did not
+		int reset_position_ = -1;
+		gf_rng rng_;
 
 
-		std::atomic<bool> param_update_busy_;
+		// Parameters are written through their shadow and applied to the fields below at the start of a block
+		gf_param_shadow param_shadows_[n_params];
+		std::atomic<bool> params_pending_{false};
 		gf_param delay_;
 		gf_param window_;
 		gf_param space_;
@@ -70,6 +82,7 @@ namespace Grainflow
 		gf_param vibrato_rate_;
 		gf_param vibrato_depth_;
 
+		// Buffers belong to the host, a grain only reads through these and never deletes them
 		T* buffer_ref_ = nullptr;
 		T* envelope_ref_ = nullptr;
 		T* delay_buf_ref_ = nullptr;
@@ -78,18 +91,22 @@ namespace Grainflow
 		T* glisson_buffer_ = nullptr;
 
 	public:
+		/// The number of samples a grain needs in gf_io_config::grain_scratch
+		static constexpr size_t scratch_size = 8 * Blocksize;
+
 		int buffer_samplerate = 48000;
 		int system_samplerate = 48000;
 
 		bool use_default_envelope = true;
 		SigType source_sample = 0;
-		bool enabled;
+		// Written by the control thread and read by the audio thread every block
+		std::atomic<bool> enabled{false};
 		/// Links to buffers - this can likely use a template argument and would be better
 
-		gf_i_buffer_reader<T, SigType> buffer_reader;
+		Reader buffer_reader;
 		gf_buffer_info buffer_info;
 
-		gf_grain() : value_table_{}, sample_id_temp_{}, density_temp_{}, amp_temp_{}, temp_sigtype_{}, glisson_temp_{},
+		gf_grain() : value_table_{}, sample_id_temp_{}, temp_sigtype_{}, glisson_temp_{},
 		             reset_pending_(false)
 		{
 			vibrato_phasor_ = std::make_unique<phasor<SigType, Blocksize>>(0, system_samplerate);
@@ -103,24 +120,15 @@ namespace Grainflow
 			n_envelopes_.value = 1;
 			glisson_rows_.value = 1;
 			density_.base = 1;
-			param_update_busy_.store(false);
+			for (int i = 0; i < n_params; ++i)
+			{
+				param_shadows_[i].reset(*param_get_handle(static_cast<gf_param_name>(i + 1)));
+			}
 			std::fill_n(sample_id_temp_, Blocksize, 0);
-			std::fill_n(density_temp_, Blocksize, 0);
-			std::fill_n(amp_temp_, Blocksize, 0);
 			std::fill_n(temp_sigtype_, Blocksize, 0);
 			std::fill_n(glisson_temp_, Blocksize, 0);
 		}
 
-		~gf_grain()
-		{
-			delete buffer_ref_;
-			delete envelope_ref_;
-			delete delay_buf_ref_;
-			delete rate_buf_ref_;
-			delete window_buf_ref_;
-			delete glisson_buffer_;
-		}
-
 	private:
 		/// @brief Returns a handle to a given grainflow parameter
 		/// @param param_name the parameter name to get the a pointer to
@@ -183,17 +191,38 @@ namespace Grainflow
 
 		/// @brief Samples a grainflow parameter using its handle by setting the value using the base, offset, and random fields in the param
 		/// @param param parameter pointer
-		inline void sample_param(gf_param* param) const
+		inline void sample_param(gf_param* param)
 		{
-			const int rng = rand();
-			param->value = abs((rng % 10000) * 0.0001f) * (param->random) + param->base + param->offset * g_;
+			param->value = rng_.uniform() * (param->random) + param->base + param->offset * g_;
 		}
 
-		static void sample_normalized(gf_param* param, const float range)
+		/// @brief Applies parameter writes made since the last block, called from the audio thread
+		inline void apply_param_updates()
 		{
-			const int rng = rand();
-			param->value = gf_utils::mod(
-				(abs((rng % 10000) * 0.0001f) * (param->random) + param->offset) * range + param->base, range);
+			if (!params_pending_.load(std::memory_order_relaxed)) return;
+			if (!params_pending_.exchange(false, std::memory_order_acquire)) return;
+			bool changed = false;
+			for (int i = 0; i < n_params; ++i)
+			{
+				changed |= param_shadows_[i].apply(*param_get_handle(static_cast<gf_param_name>(i + 1)));
+			}
+			if (changed) publish_values();
+		}
+
+		/// @brief Makes the values sampled by the audio thread visible to param_get
+		inline void publish_values()
+		{
+			for (int i = 0; i < n_params; ++i)
+			{
+				param_shadows_[i].current.store(param_get_handle(static_cast<gf_param_name>(i + 1))->value,
+				                                std::memory_order_relaxed);
+			}
+		}
+
+		static void sample_normalized(gf_rng& rng, gf_param* param, const float range)
+		{
+			param->value = gf_utils::mod((rng.uniform() * (param->random) + param->offset) * range + param->base,
+			                             range);
 		}
 
 		inline gf_value_table* grain_reset(const SigType* __restrict grain_clock, const SigType* traversal,
@@ -212,36 +241,31 @@ namespace Grainflow
 				value_table_[i].density = grain_enabled_ && !window_changed_;
 			}
 
-			bool grain_reset = (last_grain_clock_ > grain_clock[0] && grain_clock[0] >= Grainclock_Thresh) || (
-				last_grain_clock_ < Grainclock_Thresh && grain_clock[0] > Grainclock_Thresh);
-			grain_state[0] = !grain_reset && grain_clock[0] >= Grainclock_Thresh;
-			int reset_position = 0;
-			for (int i = 1; i < size; i++)
-			{
-				const bool zero_cross = (grain_clock[i - 1] > grain_clock[i] && grain_clock[i] >= Grainclock_Thresh) ||
-				(grain_clock[i - 1] <=
-					Grainclock_Thresh &&
-					grain_clock[i] > Grainclock_Thresh);
-				grain_state[i] = !zero_cross && grain_clock[i] >= Grainclock_Thresh;
-				reset_position = reset_position * !(grain_reset && zero_cross) + i * (grain_reset && zero_cross);
-				grain_reset = grain_reset || zero_cross;
-			}
+			const auto resets = gf_utils::find_transitions<gf_transition::clock_reset, SigType>(
+				grain_clock, last_grain_clock_, Grainclock_Thresh, grain_state, size);
+			const bool grain_reset = resets.count > 0;
+			// The traversal is read at the last reset when the block holds more than one, at the block start otherwise
+			const int reset_position = resets.count > 1 ? resets.last : 0;
+			const int last_reset = resets.last;
 			const int enabled_mask = enabled_internal_ ? 1 : 0;
 
 			last_grain_clock_ = grain_clock[size - 1] * enabled_mask + (1 - enabled_mask) * 0.001;
+			reset_position_ = last_reset;
 			if (!grain_reset)
 				return value_table_;
 
 			if (!buffer_reader.sample_param_buffer(get_buffer(gf_buffers::delay_buffer),
-			                                       param_get_handle(gf_param_name::delay), g_))
+			                                       param_get_handle(gf_param_name::delay), g_, rng_))
 				sample_param(
 					gf_param_name::delay);
 			source_sample = ((traversal[reset_position]) * buffer_info.buffer_frames - (delay_.value * 0.001f *
 				buffer_samplerate) - 1);
 			source_sample = gf_utils::mod<SigType>(source_sample, buffer_info.buffer_frames);
+			source_position_norm_ = buffer_info.buffer_frames > 0
+				                        ? static_cast<float>(source_sample / buffer_info.buffer_frames)
+				                        : 0.0f;
 			if (!buffer_reader.sample_param_buffer(get_buffer(gf_buffers::rate_buffer),
-			                                       param_get_handle(gf_param_name::rate),
-			                                       g_))
+			                                       param_get_handle(gf_param_name::rate), g_, rng_))
 				sample_param(gf_param_name::rate);
 
 			const auto last_window = window_.value;
@@ -249,16 +273,11 @@ namespace Grainflow
 			if (!window_changed_)
 			{
 				if (!buffer_reader.sample_param_buffer(get_buffer(gf_buffers::window_buffer),
-				                                       param_get_handle(gf_param_name::window), g_))
+				                                       param_get_handle(gf_param_name::window), g_, rng_))
 					sample_param(
 						gf_param_name::window);
 			}
 			window_changed_ = std::abs(window_.value - last_window) > 0.00000001;
-			if (param_update_busy_.load())
-			{
-				// If the parameter is being written to, we will just wait for the next crossing
-				return value_table_;
-			}
 			sample_param(&space_);
 			sample_param(&glisson_);
 			sample_param(&envelope_);
@@ -268,7 +287,7 @@ namespace Grainflow
 			sample_param(&glisson_position_);
 			sample_param(&vibrato_rate_);
 			sample_param(&vibrato_depth_);
-			sample_normalized(&channel_, buffer_info.n_channels);
+			sample_normalized(rng_, &channel_, buffer_info.n_channels);
 			sample_density();
 			sample_direction();
 
@@ -283,25 +302,15 @@ namespace Grainflow
 			value_table_[i].direction = direction_.value;
 			value_table_[i].density = !window_changed_ && grain_enabled_;
 
-			enabled_internal_ = enabled;
+			enabled_internal_ = enabled.load(std::memory_order_relaxed);
+			publish_values();
 
 			return value_table_;
 		}
 
 		inline void sample_density()
 		{
-			grain_enabled_ = density_.base > (rand() % 10000) * 0.0001f;
-		}
-
-		static inline void expand_value_table(const gf_value_table* __restrict value_frames,
-		                                      const SigType* __restrict grain_state, float* __restrict amplitudes,
-		                                      float* __restrict densities, const int size)
-		{
-			for (int j = 0; j < size; j++)
-			{
-				amplitudes[j] = value_frames[static_cast<int>(grain_state[j])].amplitude;
-				densities[j] = value_frames[static_cast<int>(grain_state[j])].density * grain_state[j];
-			}
+			grain_enabled_ = density_.base > rng_.uniform();
 		}
 
 		static inline void process_grain_clock(const SigType* __restrict grain_clock,
@@ -321,28 +330,62 @@ namespace Grainflow
 			}
 		}
 
-		inline void output_block(const SigType* __restrict sample_ids, const float* __restrict amplitudes,
-		                         const float* __restrict densities, const float one_over_buffer_frames,
-		                         const int stream, const SigType* input_amp,
+		/// @brief The row of an output at block, or a row of the config's grain_scratch when the host did not ask
+		/// for it
+		inline SigType* grain_row(const gf_io_config<SigType>& io_config, SigType** rows, const int block,
+		                          const int scratch)
+		{
+			return io_config.writes(rows) ? &rows[g_][block] : io_config.grain_scratch + scratch * Blocksize;
+		}
+
+		/// @brief Writes the outputs of a block, report outputs missing from Report are not computed
+		template <unsigned Report>
+		inline void output_block(const SigType* __restrict sample_ids, const float amplitude, const float density,
+		                         const SigType* __restrict grain_state, const float one_over_buffer_frames,
+		                         const int stream, const SigType* input_amp, const bool am_constant,
 		                         SigType* __restrict grain_playhead, SigType* __restrict grain_amp,
 		                         SigType* __restrict grain_envelope,
 		                         SigType* __restrict grain_output, SigType* __restrict grain_stream_channel,
 		                         SigType* __restrict grain_buffer_channel, const int size) const
 		{
+			if (am_constant)
+			{
+				const SigType am_gain = (1 - input_amp[0]) * amplitude;
+				for (int j = 0; j < size; j++)
+				{
+					grain_amp[j] = am_gain * (density * grain_state[j]);
+				}
+			}
+			else
+			{
+				for (int j = 0; j < size; j++)
+				{
+					grain_amp[j] = (1 - input_amp[j]) * amplitude * (density * grain_state[j]);
+				}
+			}
 			for (int j = 0; j < size; j++)
 			{
-				const float density = densities[j];;
-				const float amplitude = amplitudes[j];
-				grain_playhead[j] = sample_ids[j] * one_over_buffer_frames * density;
-				grain_amp[j] = (1 - input_amp[j]) * amplitude * density;
-				grain_envelope[j] *= density;
+				const SigType sample_density = density * grain_state[j];
+				if constexpr ((Report & gf_report_playhead) != 0)
+					grain_playhead[j] = sample_ids[j] * one_over_buffer_frames * sample_density;
+				grain_envelope[j] *= sample_density;
 				grain_output[j] *= grain_amp[j] * 0.5 * grain_envelope[j];
-				grain_stream_channel[j] = stream + 1;
-				grain_buffer_channel[j] = static_cast<int>(channel_.value) + 1;
+				if constexpr ((Report & gf_report_stream_channel) != 0)
+					grain_stream_channel[j] = stream + 1;
+				if constexpr ((Report & gf_report_buffer_channel) != 0)
+					grain_buffer_channel[j] = static_cast<int>(channel_.value) + 1;
 			}
 		}
 
-		inline void increment(const SigType* __restrict fm, const SigType* __restrict grain_clock,
+		using output_block_func = decltype(&gf_grain::output_block<gf_report_all>);
+		// Indexed by gf_io_config::report_mask() so the choice is made once per block rather than per sample
+		static constexpr output_block_func output_blocks[gf_report_all + 1] = {
+			&gf_grain::output_block<0>, &gf_grain::output_block<1>, &gf_grain::output_block<2>,
+			&gf_grain::output_block<3>, &gf_grain::output_block<4>, &gf_grain::output_block<5>,
+			&gf_grain::output_block<6>, &gf_grain::output_block<7>,
+		};
+
+		inline void increment(const SigType* __restrict fm, const bool fm_constant, const SigType* __restrict grain_clock,
 		                      SigType* __restrict sample_positions, SigType* __restrict sample_delta_temp,
 		                      SigType* __restrict glisson_temp, const int samplerate, const int size)
 		{
@@ -360,15 +403,19 @@ namespace Grainflow
 			if (vibrato_rate_.value > 0.0f && vibrato_depth_.value > 0.0f)
 			{
 				vibrato_phasor_->set_rate(vibrato_rate_.value, samplerate);
-				vibrato_phasor_->perform(glisson_temp);
+				vibrato_phasor_->perform(glisson_temp, size);
 				GfSyn::ChevyshevSin<SigType, Blocksize>(sample_delta_temp, glisson_temp);
 				auto depth = vibrato_depth_.value;
-				std::transform(sample_delta_temp, sample_delta_temp + Blocksize, fm, sample_delta_temp,
+				std::transform(sample_delta_temp, sample_delta_temp + size, fm, sample_delta_temp,
 				               [depth](auto a, auto fm)
 				               {
 					               return gf_utils::pitch_to_rate(fm + a * depth * 0.5f);
 				               });
 			}
+			else if (fm_constant)
+			{
+				std::fill_n(sample_delta_temp, size, gf_utils::pitch_to_rate(fm[0]));
+			}
 			else
 			{
 				for (int i = 0; i < size; i++)
@@ -397,18 +444,12 @@ namespace Grainflow
 			}
 
 			sample_positions[0] = source_sample;
-			for (int i = 1; i < size; i++)
-			{
-				sample_positions[i] = sample_positions[i - 1] + sample_delta_temp[i - 1];
-			}
+			gf_kernels::scan(sample_positions + 1, sample_delta_temp, sample_positions[0], size - 1);
 
 			source_sample = gf_utils::mod(sample_positions[size - 1] + sample_delta_temp[size - 1],
 			                              buffer_info.buffer_frames * 2.0);
 
-			for (int i = 0; i < size; i++)
-			{
-				sample_positions[i] = gf_utils::pong(sample_positions[i], start, end, fold);
-			}
+			gf_kernels::fold(sample_positions, start, end, fold, size);
 		}
 
 		void sample_direction()
@@ -419,7 +460,7 @@ namespace Grainflow
 				direction_.value = -1;
 			else
 			{
-				if (const float random_direction = (rand() % 1000) * 0.001f; random_direction > direction_.base)
+				if (const float random_direction = rng_.uniform(); random_direction > direction_.base)
 				{
 					direction_.value = -1;
 				}
@@ -433,10 +474,11 @@ namespace Grainflow
 	public:
 		inline void process(gf_io_config<SigType>& io_config)
 		{
-			if (!enabled && !enabled_internal_)
+			apply_param_updates();
+			if (!enabled.load(std::memory_order_relaxed) && !enabled_internal_)
 				return;
 
-			if (io_config.block_size < Blocksize)
+			if (io_config.block_size < 1)
 				return;
 			auto buffer_valid = buffer_reader.update_buffer_info(buffer_ref_, io_config, &buffer_info);
 			use_default_envelope = !buffer_reader.update_buffer_info(envelope_ref_, io_config, nullptr);
@@ -446,10 +488,13 @@ namespace Grainflow
 			if (io_config.grain_clock[0] == io_config.grain_clock[1])
 				return;
 			const float window_val = window_.value;
+			const unsigned report = io_config.report_mask();
+			int reset_offset = -1;
 
-			for (int i = 0; i < io_config.block_size / Blocksize; i++)
+			// Host blocks that are not a multiple of Blocksize finish with a shorter block so no samples are dropped
+			for (int block = 0; block < io_config.block_size; block += Blocksize)
 			{
-				const int block = i * Blocksize;
+				const int size = std::min(static_cast<int>(Blocksize), io_config.block_size - block);
 				auto amp = amplitude_.value;
 				const SigType* grain_clock = &io_config.grain_clock[g_ % io_config.grain_clock_chans][block];
 				SigType* input_amp = &io_config.am[g_ % io_config.am_chans][block];
@@ -457,99 +502,191 @@ namespace Grainflow
 				const SigType* traversal_phasor = &io_config.traversal_phasor[g_ % io_config.traversal_phasor_chans][
 					block];
 
-				SigType* grain_progress = &io_config.grain_progress[g_][block];
-				SigType* grain_state = &io_config.grain_state[g_][block];
-				SigType* grain_playhead = &io_config.grain_playhead[g_][block];
-				SigType* grain_amp = &io_config.grain_amp[g_][block];
-				SigType* grain_envelope = &io_config.grain_envelope[g_][block];
-				SigType* grain_output = &io_config.grain_output[g_][block];
-				SigType* grain_channels = &io_config.grain_buffer_channel[g_][block];
-				SigType* grain_streams = &io_config.grain_stream_channel[g_][block];
-
-				process_grain_clock(grain_clock, grain_progress, window_val, window_portion, Blocksize);
-				auto valueFrames = grain_reset(grain_progress, traversal_phasor, grain_state, Blocksize);
+				SigType* grain_progress = grain_row(io_config, io_config.grain_progress, block, 0);
+				SigType* grain_state = grain_row(io_config, io_config.grain_state, block, 1);
+				SigType* grain_playhead = grain_row(io_config, io_config.grain_playhead, block, 2);
+				SigType* grain_amp = grain_row(io_config, io_config.grain_amp, block, 3);
+				SigType* grain_envelope = grain_row(io_config, io_config.grain_envelope, block, 4);
+				SigType* grain_output = grain_row(io_config, io_config.grain_output, block, 5);
+				SigType* grain_channels = grain_row(io_config, io_config.grain_buffer_channel, block, 6);
+				SigType* grain_streams = grain_row(io_config, io_config.grain_stream_channel, block, 7);
+				// Control rate inputs only need their rate and gain computed once per block
+				const bool fm_constant = io_config.fm_scalar || gf_utils::is_constant(fm, size);
+				const bool am_constant = io_config.am_scalar || gf_utils::is_constant(input_amp, size);
+
+				process_grain_clock(grain_clock, grain_progress, window_val, window_portion, size);
+				auto valueFrames = grain_reset(grain_progress, traversal_phasor, grain_state, size);
+				if (reset_position_ >= 0) reset_offset = block + reset_position_;
 				if (!enabled_internal_)
 				{
-					std::fill_n(grain_state, Blocksize, 0.0);
-					std::fill_n(grain_progress, Blocksize, 0.0);
+					std::fill_n(grain_state, size, 0.0);
+					std::fill_n(grain_progress, size, 0.0);
 					continue;
 				}
 				if (window_changed_)
 				{
 					// todo: Stopping grain state will break the panner (fix this)
-					std::fill_n(grain_progress, Blocksize, 0.0);
+					std::fill_n(grain_progress, size, 0.0);
 					continue;
 				}
-				increment(fm, grain_progress, sample_id_temp_, temp_sigtype_, glisson_temp_, system_samplerate,
-				          Blocksize);
+				increment(fm, fm_constant, grain_progress, sample_id_temp_, temp_sigtype_, glisson_temp_,
+				          system_samplerate, size);
 				buffer_reader.sample_envelope(envelope_ref_, use_default_envelope, n_envelopes_.value, envelope_.value,
-				                              grain_envelope, grain_progress, Blocksize);
+				                              grain_envelope, grain_progress, size);
 				if (sample_id_temp_[0] != sample_id_temp_[0])
 					continue; // Nan check
 				if (buffer_valid)
 				{
 					buffer_reader.sample_buffer(buffer_ref_, channel_.value, grain_output, sample_id_temp_,
-					                            Blocksize, start_point_.value, stop_point_.value);
+					                            size, start_point_.value, stop_point_.value);
+				}
+				// Samples of the grain before a reset in this block and after it both read the second entry of the
+				// table, the first is only paired with a zero grain state. Both segments therefore share one set of
+				// constants and the grain state row masks the samples between grains.
+				const auto& values = valueFrames[1];
+				(this->*output_blocks[report])(sample_id_temp_, values.amplitude, values.density, grain_state,
+				                               buffer_info.one_over_buffer_frames, stream_, input_amp, am_constant,
+				                               grain_playhead, grain_amp, grain_envelope, grain_output, grain_streams,
+				                               grain_channels, size);
+				if (io_config.bus_output != nullptr && io_config.bus_chans > 0)
+				{
+					SigType* bus = &io_config.bus_output[io_config.bus_index(
+						static_cast<int>(stream_), static_cast<int>(channel_.value))][block];
+					for (int j = 0; j < size; ++j)
+					{
+						bus[j] += grain_output[j];
+					}
 				}
-				expand_value_table(valueFrames, grain_state, amp_temp_, density_temp_, Blocksize);
-				output_block(sample_id_temp_, amp_temp_, density_temp_, buffer_info.one_over_buffer_frames, stream_,
-				             input_amp, grain_playhead, grain_amp, grain_envelope, grain_output, grain_streams,
-				             grain_channels, Blocksize);
 			}
+			if (io_config.grain_meta != nullptr) write_meta(io_config.grain_meta[g_], reset_offset);
+		}
+
+		/// @brief Fills the block metadata of this grain
+		void write_meta(gf_grain_meta& meta, const int reset_offset) const
+		{
+			meta.stream = static_cast<int>(stream_) + 1;
+			meta.buffer_channel = static_cast<int>(channel_.value) + 1;
+			meta.reset_offset = reset_offset;
+			meta.start_position = source_position_norm_;
+			meta.rate = rate_.value;
+			meta.amplitude = amplitude_.value;
 		}
 
 		void set_index(int g) { this->g_ = g; }
 
-		inline float param_get(const gf_param_name param)
+		/// @brief Seeds the generator used for random parameter values, call before processing starts
+		void seed(const std::uint64_t seed) { rng_.seed(seed); }
+
+		/// @brief Returns playback to the state of a newly constructed grain while keeping parameters, buffers and
+		/// the enabled flag. Sampled parameter values go back to the last value written by param_set. Together with
+		/// seed() this makes a render repeatable. Must not be called while the grain is processing.
+		void reset_state()
 		{
-			return param_get_handle(param)->value;
+			apply_param_updates();
+			reset_ = false;
+			last_grain_clock_ = -999;
+			source_position_norm_ = 0;
+			reset_position_ = -1;
+			grain_enabled_ = true;
+			value_table_[0] = {};
+			value_table_[1] = {};
+			enabled_internal_ = false;
+			window_changed_ = false;
+			source_sample = 0;
+			vibrato_phasor_->reset();
+			for (int i = 0; i < n_params; ++i)
+			{
+				param_get_handle(static_cast<gf_param_name>(i + 1))->value = param_shadows_[i].value.load(
+					std::memory_order_relaxed);
+			}
+			publish_values();
 		}
 
-		void param_set(const float value, const gf_param_name param, const gf_param_type type)
+		/// @brief Copies parameters, buffers and playback state from a grain with a different internal block size so
+		/// that playback can continue after switching block sizes
+		template <size_t OtherBlocksize>
+		void copy_state(const gf_grain<T, OtherBlocksize, SigType, Reader>& other)
 		{
-			param_update_busy_.store(true);
-			gf_param* selected_param = param_get_handle(param);
-
-			switch (type)
+			last_grain_clock_ = other.last_grain_clock_;
+			source_position_norm_ = other.source_position_norm_;
+			grain_enabled_ = other.grain_enabled_;
+			value_table_[0] = other.value_table_[0];
+			value_table_[1] = other.value_table_[1];
+			g_ = other.g_;
+			enabled_internal_ = other.enabled_internal_;
+			window_changed_ = other.window_changed_;
+			stream_ = other.stream_;
+			rng_ = other.rng_;
+
+			delay_ = other.delay_;
+			window_ = other.window_;
+			space_ = other.space_;
+			amplitude_ = other.amplitude_;
+			rate_ = other.rate_;
+			glisson_ = other.glisson_;
+			envelope_ = other.envelope_;
+			direction_ = other.direction_;
+			n_envelopes_ = other.n_envelopes_;
+			glisson_rows_ = other.glisson_rows_;
+			glisson_position_ = other.glisson_position_;
+			rate_quantize_semi_ = other.rate_quantize_semi_;
+			loop_mode_ = other.loop_mode_;
+			start_point_ = other.start_point_;
+			stop_point_ = other.stop_point_;
+			channel_ = other.channel_;
+			density_ = other.density_;
+			vibrato_rate_ = other.vibrato_rate_;
+			vibrato_depth_ = other.vibrato_depth_;
+			for (int i = 0; i < n_params; ++i)
 			{
-			case (gf_param_type::base):
-				selected_param->base = value;
-				break;
-			case (gf_param_type::random):
-				selected_param->random = value;
-				break;
-			case (gf_param_type::offset):
-				selected_param->offset = value;
-				break;
-			case (gf_param_type::mode):
-				selected_param->mode = static_cast<gf_buffer_mode>(static_cast<int>(value));
-				break;
-			case (gf_param_type::value):
-				selected_param->value = value;
-				break;
-			default:
-				throw("invalid type");
-				break;
+				param_shadows_[i].copy(other.param_shadows_[i]);
 			}
-			param_update_busy_.store(false);
+			params_pending_.store(other.params_pending_.load());
+
+			buffer_ref_ = other.buffer_ref_;
+			envelope_ref_ = other.envelope_ref_;
+			delay_buf_ref_ = other.delay_buf_ref_;
+			rate_buf_ref_ = other.rate_buf_ref_;
+			window_buf_ref_ = other.window_buf_ref_;
+			glisson_buffer_ = other.glisson_buffer_;
+
+			buffer_samplerate = other.buffer_samplerate;
+			system_samplerate = other.system_samplerate;
+			use_default_envelope = other.use_default_envelope;
+			source_sample = other.source_sample;
+			enabled.store(other.enabled.load());
+			buffer_reader = other.buffer_reader;
+			buffer_info = other.buffer_info;
+			vibrato_phasor_->reset(other.vibrato_phasor_->phase());
+		}
+
+		/// @brief A grain is active while it is enabled or still finishing the grain it started before being disabled
+		[[nodiscard]] inline bool active() const
+		{
+			return enabled.load(std::memory_order_relaxed) || enabled_internal_;
+		}
+
+		inline float param_get(const gf_param_name param)
+		{
+			return param_get(param, gf_param_type::value);
+		}
+
+		/// @brief Sets a parameter field. Safe to call while the grain is processing, the write is applied at the
+		/// start of the next block.
+		void param_set(const float value, const gf_param_name param, const gf_param_type type)
+		{
+			if (param == gf_param_name::ERR || static_cast<int>(param) > n_params) return;
+			if (type == gf_param_type::ERR || type > gf_param_type::value) throw("invalid type");
+			param_shadows_[static_cast<int>(param) - 1].set(type, value);
+			params_pending_.store(true, std::memory_order_release);
 		}
 
+		/// @brief Reads the latest written field, or for the value field the value last used by the audio thread
 		inline float param_get(const gf_param_name param_name, const gf_param_type param_type)
 		{
-			const auto param = param_get_handle(param_name);
-			switch (param_type)
-			{
-			case (gf_param_type::base):
-				return param->base;
-			case (gf_param_type::random):
-				return param->random;
-			case (gf_param_type::offset):
-				return param->offset;
-			case (gf_param_type::value):
-				return param->value;
-			default:
-				return 0;
-			}
+			if (param_name == gf_param_name::ERR || static_cast<int>(param_name) > n_params) return 0;
+			if (param_type == gf_param_type::mode) return 0;
+			return param_shadows_[static_cast<int>(param_name) - 1].get(param_type);
 		}
 
 		void set_buffer(const gf_buffers buffer_type, T* buffer)
@@ -597,7 +734,7 @@ namespace Grainflow
 			return nullptr;
 		}
 
-		void stream_set(const int max_grains, const gf_stream_set_type mode, const int nstreams)
+		void stream_set(const int max_grains, const gf_stream_set_type mode, const int nstreams, gf_rng& rng)
 		{
 			switch (mode)
 			{
@@ -613,7 +750,7 @@ namespace Grainflow
 				}
 			case gf_stream_set_type::random_streams:
 				{
-					stream_ = rand() % (nstreams);
+					stream_ = rng.below(nstreams);
 					break;
 				}
 			case gf_stream_set_type::manual_streams:
@@ -1,39 +1,147 @@
 #pragma once
 #include "gfGrain.h"
 #include "gfParam.h"
+#include "gfThreadPool.h"
 #include <memory>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 
 namespace Grainflow
 {
-	template <typename T, size_t Internalblock, typename SigType = double>
+	/// @brief Reader is the buffer reader policy handed to every grain, see gf_grain
+	template <typename T, size_t Internalblock, typename SigType = double,
+	          typename Reader = gf_i_buffer_reader<T, SigType>>
 	class gf_grain_collection
 	{
+		template <typename, size_t, typename, typename>
+		friend class gf_grain_collection;
+
 	private:
-		std::unique_ptr<gf_grain<T, Internalblock, SigType>[]> grains_;
-		gf_i_buffer_reader<T, SigType> buffer_reader_;
+		std::unique_ptr<gf_grain<T, Internalblock, SigType, Reader>[]> grains_;
+		Reader buffer_reader_;
 		int grain_count_ = 0;
 		int active_grains_ = 0;
 		int nstreams_ = 0;
 		bool auto_overlap_ = true;
+		gf_thread_pool* thread_pool_ = nullptr;
+		int grains_per_chunk_ = 16;
+		gf_io_config<SigType>* pending_config_ = nullptr;
+		const int* pending_list_ = nullptr;
+		// Bus sums of each chunk of grains. They are added up in chunk order so the bus outputs do not depend on
+		// the thread count or on which worker ran a chunk.
+		std::vector<SigType> bus_storage_;
+		std::vector<SigType*> bus_rows_;
+		int bus_stride_ = 0;
+		// gf_grain::scratch_size samples per chunk so chunks running on different workers never share scratch
+		std::vector<SigType> scratch_storage_;
+		bool bus_chunked_ = false;
+		std::uint64_t seed_ = 0;
+		bool seeded_ = false;
+		// Used for control side draws such as random stream assignment
+		gf_rng rng_;
+		// Internal generators that replace the grain_clock and traversal_phasor inputs when they have channels
+		phasor_bank<SigType, Internalblock> clock_;
+		phasor_bank<SigType, Internalblock> traversal_;
+
+		// Grains that are enabled or still fading out, owned by the audio thread.
+		// The control thread only bumps active_generation_ and the list is rebuilt at the start of the next block.
+		std::unique_ptr<int[]> active_list_;
+		int active_list_size_ = 0;
+		// Grains processed in the last block, the only ones whose grain_meta entry can hold a reset
+		std::unique_ptr<int[]> processed_list_;
+		int processed_list_size_ = 0;
+		std::atomic<unsigned int> active_generation_{0};
+		unsigned int applied_generation_ = 0;
+
+		void rebuild_active_list();
+
+		void prune_active_list();
+
+		static void process_range(void* collection, int begin, int end);
+
+		void process_chunk(int begin, int end);
+
+		void process_bus(gf_io_config<SigType>& io_config, const int* grain_list, int count);
+
+		void reserve_bus(int bus_chans, int block_size, int chunks);
+
+		void reserve_scratch();
 
 	public:
 		int samplerate = 48000;
 
-		explicit gf_grain_collection(gf_i_buffer_reader<T, SigType> buffer_reader, int grain_count = 0);
+		explicit gf_grain_collection(Reader buffer_reader, int grain_count = 0);
 
-		~gf_grain_collection();
+		~gf_grain_collection() = default;
 
 		void resize(int grain_count);
 
 		[[nodiscard]] int grains() const;
 
-		gf_grain<T, Internalblock, SigType>* get_grain(int index);
+		gf_grain<T, Internalblock, SigType, Reader>* get_grain(int index);
+
+		/// @brief Resizes this collection to match another collection and copies its grains, parameters and streams.
+		/// This allocates and should not be called from the audio thread.
+		template <size_t OtherInternalblock>
+		void copy_state(const gf_grain_collection<T, OtherInternalblock, SigType, Reader>& other);
 
 
 #pragma region DSP
 		// Processes all grain given an io config with the correct inputs and outputs  
 		void process(gf_io_config<SigType>& io_config);
 
+		/// @brief Processes only the listed grains, for callers that track which grains are sounding themselves.
+		/// Rows and metadata of grains that are not listed are left as they are.
+		/// @param grain_list zero based grain indices, each listed once
+		void process(gf_io_config<SigType>& io_config, const int* grain_list, int count);
+
+		/// @brief Splits processing across a shared pool of workers. Each grain only writes its own output rows so
+		/// the result does not depend on how the grains are distributed. Passing nullptr processes on the calling thread.
+		/// Allocates scratch for each chunk, call it outside of the audio thread.
+		/// @param thread_pool a pool that outlives the collection or nullptr
+		/// @param grains_per_chunk the number of grains each worker claims at a time
+		void set_thread_pool(gf_thread_pool* thread_pool, int grains_per_chunk = 16);
+
+		/// @brief Allocates the bus sums used when the io config has bus outputs, so the first processed block does
+		/// not allocate. Call after resize() and set_thread_pool(), outside of the audio thread.
+		void prepare_bus(int bus_chans, int max_block_size);
+
+		/// @brief Gives every grain its own generator derived from seed and its index, so the random values a grain
+		/// draws do not depend on thread count or processing order. The seed is kept across resize().
+		void seed(std::uint64_t seed);
+
+		/// @brief Returns every grain to its initial playback state and reseeds it when a seed was set. Rendering the
+		/// same inputs after reset_state() reproduces the same output. Must not be called while processing.
+		void reset_state();
+
+		/// @brief Generates the grain clocks internally so the grain_clock input can be left empty. Grains read
+		/// channel g % channels like they do with host clocks. Zero channels goes back to the host input.
+		/// This reallocates the rows process() reads and must not be called while processing.
+		/// @param rate the grain rate in Hz of every channel
+		/// @param max_block_size the largest host block, longer blocks allocate on the audio thread
+		void set_internal_clock(int channels, float rate = 1, int max_block_size = 512);
+
+		/// @brief Generates the traversal phasors internally so the traversal_phasor input can be left empty.
+		/// Zero channels goes back to the host input. This reallocates the rows process() reads and must not be called
+		/// while processing.
+		/// @param rate the traversal rate in Hz of every channel, the inverse of the buffer length in seconds plays
+		/// through the buffer in real time
+		/// @param max_block_size the largest host block, longer blocks allocate on the audio thread
+		void set_internal_traversal(int channels, float rate = 0, int max_block_size = 512);
+
+		/// @brief Sets the rate in Hz of an internal clock channel, target 0 sets every channel
+		void clock_rate_set(int target, float rate);
+
+		/// @brief Moves an internal clock channel to a phase in [0, 1), target 0 sets every channel
+		void clock_phase_set(int target, float phase);
+
+		/// @brief Sets the rate in Hz of an internal traversal channel, target 0 sets every channel
+		void traversal_rate_set(int target, float rate);
+
+		/// @brief Moves an internal traversal channel to a phase in [0, 1), target 0 sets every channel
+		void traversal_phase_set(int target, float phase);
+
 #pragma endregion
 
 #pragma region Params
@@ -44,6 +152,14 @@ namespace Grainflow
 
 		GF_RETURN_CODE param_set(int target, const std::string& reflection_string, float value);
 
+		/// @brief Sets a parameter through a handle resolved with param_handle()
+		GF_RETURN_CODE param_set(int target, gf_param_handle handle, float value);
+
+		/// @brief Applies a batch of updates, sweeping the grains once per run of broadcasts. Updates are applied in
+		/// order so a later update to the same field wins. Invalid handles are skipped.
+		/// @return GF_PARAM_NOT_FOUND if any handle was invalid
+		GF_RETURN_CODE param_set(const gf_param_update* updates, int count);
+
 		void channel_param_set(int channel, gf_param_name param_name, gf_param_type param_type, float value);
 
 		GF_RETURN_CODE channel_param_set(int channel, const std::string& reflection_string, float value);
@@ -66,6 +182,7 @@ namespace Grainflow
 
 		void set_auto_overlap(bool auto_overlap);
 		bool get_auto_overlap();
+		/// @brief Points grains at a buffer owned by the host, which keeps it alive while the collection can read it
 		GF_RETURN_CODE set_buffer(gf_buffers type, T* ref, int target);
 		GF_RETURN_CODE set_buffer(std::string reflectionString, T* ref, int target);
 
@@ -106,9 +223,9 @@ namespace Grainflow
 		void channel_mode_set(int mode);
 	};
 
-	template <typename T, size_t Internalblock, typename SigType>
-	gf_grain_collection<T, Internalblock, SigType>::gf_grain_collection(gf_i_buffer_reader<T, SigType> buffer_reader,
-	                                                                    const int grain_count)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	gf_grain_collection<T, Internalblock, SigType, Reader>::gf_grain_collection(Reader buffer_reader,
+	                                                                            const int grain_count)
 	{
 		this->buffer_reader_ = buffer_reader;
 		if (grain_count > 0)
@@ -117,76 +234,367 @@ namespace Grainflow
 		}
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	gf_grain_collection<T, Internalblock, SigType>::~gf_grain_collection()
-	{
-		grains_.release();
-	}
-
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::resize(const int grain_count)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::resize(const int grain_count)
 	{
 		grain_count_ = grain_count;
-		grains_.reset(new gf_grain<T, Internalblock, SigType>[grain_count]);
+		grains_.reset(new gf_grain<T, Internalblock, SigType, Reader>[grain_count]);
+		active_list_.reset(new int[grain_count]);
+		active_list_size_ = 0;
+		processed_list_.reset(new int[grain_count]);
+		processed_list_size_ = 0;
 		for (int i = 0; i < grain_count; i++)
 		{
 			grains_[i].buffer_reader = buffer_reader_;
 			grains_[i].set_index(i);
 			grains_[i].system_samplerate = samplerate;
+			if (seeded_) grains_[i].seed(gf_rng::derive_seed(seed_, i));
 		}
+		reserve_scratch();
 		set_active_grains(grain_count);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	int gf_grain_collection<T, Internalblock, SigType>::grains() const
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	int gf_grain_collection<T, Internalblock, SigType, Reader>::grains() const
 	{
 		return grain_count_;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	gf_grain<T, Internalblock, SigType>* gf_grain_collection<T, Internalblock, SigType>::get_grain(int index)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	gf_grain<T, Internalblock, SigType, Reader>* gf_grain_collection<T, Internalblock, SigType, Reader>::get_grain(
+		const int index)
 	{
 		if (index >= grain_count_) return nullptr;
 		return &grains_[index];
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::process(gf_io_config<SigType>& io_config)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	template <size_t OtherInternalblock>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::copy_state(
+		const gf_grain_collection<T, OtherInternalblock, SigType, Reader>& other)
+	{
+		buffer_reader_ = other.buffer_reader_;
+		samplerate = other.samplerate;
+		auto_overlap_ = other.auto_overlap_;
+		nstreams_ = other.nstreams_;
+		thread_pool_ = other.thread_pool_;
+		grains_per_chunk_ = other.grains_per_chunk_;
+		seed_ = other.seed_;
+		seeded_ = other.seeded_;
+		rng_ = other.rng_;
+		clock_.copy(other.clock_);
+		traversal_.copy(other.traversal_);
+		resize(other.grain_count_);
+		for (int g = 0; g < grain_count_; g++)
+		{
+			grains_[g].copy_state(other.grains_[g]);
+		}
+		active_grains_ = other.active_grains_;
+		// Keeps every bus row and the block size reserved by prepare_bus() so the first block after a switch does
+		// not allocate
+		if (!other.bus_rows_.empty())
+		{
+			reserve_bus(static_cast<int>(other.bus_rows_.size()), other.bus_stride_, 1);
+		}
+		active_generation_.fetch_add(1, std::memory_order_release);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::process(gf_io_config<SigType>& io_config)
+	{
+		if (const auto generation = active_generation_.load(std::memory_order_acquire); generation !=
+			applied_generation_)
+		{
+			rebuild_active_list();
+			applied_generation_ = generation;
+		}
+		// Grains that are not processed this block did not reset, the processed ones overwrite their entry
+		for (int i = 0; io_config.grain_meta != nullptr && i < processed_list_size_; i++)
+		{
+			io_config.grain_meta[processed_list_[i]].reset_offset = -1;
+		}
+		if (clock_.channels() > 0 || traversal_.channels() > 0)
+		{
+			auto config = io_config;
+			if (clock_.channels() > 0)
+			{
+				config.grain_clock = clock_.perform(io_config.block_size, samplerate);
+				config.grain_clock_chans = clock_.channels();
+			}
+			if (traversal_.channels() > 0)
+			{
+				config.traversal_phasor = traversal_.perform(io_config.block_size, samplerate);
+				config.traversal_phasor_chans = traversal_.channels();
+			}
+			process(config, active_list_.get(), active_list_size_);
+		}
+		else
+		{
+			process(io_config, active_list_.get(), active_list_size_);
+		}
+		prune_active_list();
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::process(gf_io_config<SigType>& io_config,
+	                                                                     const int* grain_list, const int count)
+	{
+		if (io_config.bus_output != nullptr && io_config.bus_chans > 0)
+		{
+			process_bus(io_config, grain_list, count);
+			return;
+		}
+		if (thread_pool_ == nullptr)
+		{
+			auto config = io_config;
+			config.grain_scratch = scratch_storage_.data();
+			for (int i = 0; i < count; i++)
+			{
+				grains_.get()[grain_list[i]].process(config);
+			}
+			return;
+		}
+		pending_config_ = &io_config;
+		pending_list_ = grain_list;
+		thread_pool_->run(&process_range, this, count, grains_per_chunk_);
+		pending_config_ = nullptr;
+		pending_list_ = nullptr;
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::process_range(void* collection, const int begin,
+	                                                                           const int end)
+	{
+		// A pool without workers hands over every chunk in one call, each chunk still gets its own scratch and buses
+		auto self = static_cast<gf_grain_collection*>(collection);
+		for (int first = begin; first < end; first += self->grains_per_chunk_)
+		{
+			self->process_chunk(first, std::min(first + self->grains_per_chunk_, end));
+		}
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::process_chunk(const int begin, const int end)
+	{
+		const int chunk = begin / grains_per_chunk_;
+		auto config = *pending_config_;
+		config.grain_scratch = &scratch_storage_[static_cast<size_t>(chunk) *
+			gf_grain<T, Internalblock, SigType, Reader>::scratch_size];
+		if (!bus_chunked_)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				grains_.get()[pending_list_[i]].process(config);
+			}
+			return;
+		}
+		// Each chunk sums into its own buses
+		config.bus_output = &bus_rows_[static_cast<size_t>(chunk) * config.bus_chans];
+		for (int ch = 0; ch < config.bus_chans; ch++)
+		{
+			std::fill_n(config.bus_output[ch], config.block_size, 0.0);
+		}
+		for (int i = begin; i < end; i++)
+		{
+			grains_.get()[pending_list_[i]].process(config);
+		}
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::process_bus(gf_io_config<SigType>& io_config,
+	                                                                         const int* grain_list, const int count)
 	{
+		const int chunks = (count + grains_per_chunk_ - 1) / grains_per_chunk_;
+		if (chunks <= 1)
+		{
+			for (int ch = 0; ch < io_config.bus_chans; ch++)
+			{
+				std::fill_n(io_config.bus_output[ch], io_config.block_size, 0.0);
+			}
+			auto config = io_config;
+			config.grain_scratch = scratch_storage_.data();
+			for (int i = 0; i < count; i++)
+			{
+				grains_.get()[grain_list[i]].process(config);
+			}
+			return;
+		}
+
+		// The same chunks are used with and without a thread pool so both give the same sums
+		reserve_bus(io_config.bus_chans, io_config.block_size, chunks);
+		pending_config_ = &io_config;
+		pending_list_ = grain_list;
+		bus_chunked_ = true;
+		if (thread_pool_ == nullptr)
+		{
+			process_range(this, 0, count);
+		}
+		else
+		{
+			thread_pool_->run(&process_range, this, count, grains_per_chunk_);
+		}
+		bus_chunked_ = false;
+		pending_config_ = nullptr;
+		pending_list_ = nullptr;
+
+		for (int ch = 0; ch < io_config.bus_chans; ch++)
+		{
+			SigType* bus = io_config.bus_output[ch];
+			std::copy_n(bus_rows_[ch], io_config.block_size, bus);
+			for (int c = 1; c < chunks; c++)
+			{
+				const SigType* chunk_bus = bus_rows_[static_cast<size_t>(c) * io_config.bus_chans + ch];
+				for (int j = 0; j < io_config.block_size; j++)
+				{
+					bus[j] += chunk_bus[j];
+				}
+			}
+		}
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::reserve_bus(const int bus_chans, const int block_size,
+	                                                                         const int chunks)
+	{
+		const size_t rows = static_cast<size_t>(bus_chans) * chunks;
+		if (bus_rows_.size() >= rows && bus_stride_ >= block_size) return;
+		bus_stride_ = std::max(bus_stride_, block_size);
+		const size_t row_count = std::max(rows, bus_rows_.size());
+		bus_storage_.assign(row_count * bus_stride_, 0);
+		bus_rows_.resize(row_count);
+		for (size_t r = 0; r < row_count; r++)
+		{
+			bus_rows_[r] = &bus_storage_[r * bus_stride_];
+		}
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::reserve_scratch()
+	{
+		const int chunks = std::max((grain_count_ + grains_per_chunk_ - 1) / grains_per_chunk_, 1);
+		scratch_storage_.assign(static_cast<size_t>(chunks) * gf_grain<T, Internalblock, SigType, Reader>::scratch_size,
+		                        0);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::rebuild_active_list()
+	{
+		active_list_size_ = 0;
+		for (int g = 0; g < grain_count_; g++)
+		{
+			if (!grains_[g].active()) continue;
+			active_list_[active_list_size_++] = g;
+		}
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::prune_active_list()
+	{
+		// Drops grains that finished fading out while keeping the list in grain order
+		int size = 0;
+		for (int i = 0; i < active_list_size_; i++)
+		{
+			const int g = active_list_[i];
+			processed_list_[i] = g;
+			active_list_[size] = g;
+			size += grains_[g].active();
+		}
+		processed_list_size_ = active_list_size_;
+		active_list_size_ = size;
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::set_thread_pool(gf_thread_pool* thread_pool,
+	                                                                             const int grains_per_chunk)
+	{
+		thread_pool_ = thread_pool;
+		grains_per_chunk_ = std::max(grains_per_chunk, 1);
+		reserve_scratch();
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::prepare_bus(const int bus_chans,
+	                                                                         const int max_block_size)
+	{
+		reserve_bus(std::max(bus_chans, 1), std::max(max_block_size, 1),
+		            std::max((grain_count_ + grains_per_chunk_ - 1) / grains_per_chunk_, 1));
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::seed(const std::uint64_t seed)
+	{
+		seed_ = seed;
+		seeded_ = true;
+		rng_.seed(gf_rng::derive_seed(seed, ~0ull));
 		for (int g = 0; g < grain_count_; g++)
 		{
-			grains_.get()[g].process(io_config);
+			grains_[g].seed(gf_rng::derive_seed(seed, g));
 		}
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::transform_params(gf_param_name& param_name,
-	                                                                      const gf_param_type& param_type,
-	                                                                      float& value)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::reset_state()
 	{
-		if (param_type == gf_param_type::mode) return; //Modes are not a value type and should not be effected 
-		switch (param_name)
+		if (seeded_) seed(seed_);
+		for (int g = 0; g < grain_count_; g++)
 		{
-		case gf_param_name::transpose:
-			if (param_type == gf_param_type::base) value = gf_utils::pitch_to_rate(value);
-			else value = gf_utils::pitch_offset_to_rate_offset(value);
-			param_name = gf_param_name::rate;
-			break;
-		case gf_param_name::glisson_st:
-			value = gf_utils::pitch_offset_to_rate_offset(value);
-			param_name = gf_param_name::glisson;
-			break;
-		case gf_param_name::amplitude:
-			if (param_type == gf_param_type::base) break;
-			value = std::max(std::min(-value, 0.0f), -1.0f);
-			break;
-		default:
-			break;
+			grains_[g].reset_state();
 		}
+		active_generation_.fetch_add(1, std::memory_order_release);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::set_buffer(gf_buffers type, T* ref, int target)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::set_internal_clock(const int channels,
+	                                                                                const float rate,
+	                                                                                const int max_block_size)
+	{
+		clock_.resize(channels, rate, max_block_size);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::set_internal_traversal(const int channels,
+	                                                                                    const float rate,
+	                                                                                    const int max_block_size)
+	{
+		traversal_.resize(channels, rate, max_block_size);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::clock_rate_set(const int target, const float rate)
+	{
+		clock_.set_rate(target - 1, rate);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::clock_phase_set(const int target, const float phase)
+	{
+		clock_.set_phase(target - 1, phase);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::traversal_rate_set(const int target, const float rate)
+	{
+		traversal_.set_rate(target - 1, rate);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::traversal_phase_set(const int target,
+	                                                                                 const float phase)
+	{
+		traversal_.set_phase(target - 1, phase);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::transform_params(gf_param_name& param_name,
+	                                                                              const gf_param_type& param_type,
+	                                                                              float& value)
+	{
+		param_transform(param_name, param_type, value);
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::set_buffer(gf_buffers type, T* ref,
+	                                                                                  int target)
 	{
 		if (target == 0)
 		{
@@ -201,8 +609,8 @@ namespace Grainflow
 		return GF_RETURN_CODE::GF_SUCCESS;
 	};
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::set_buffer(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::set_buffer(
 		std::string reflectionString, T* ref, int target)
 	{
 		gf_buffers type;
@@ -211,12 +619,12 @@ namespace Grainflow
 		return set_buffer(type, ref, target);
 	};
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::param_set(int target, gf_param_name param_name,
-	                                                               gf_param_type param_type,
-	                                                               float value)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::param_set(int target, gf_param_name param_name,
+	                                                                       gf_param_type param_type,
+	                                                                       float value)
 	{
-		if (target > grain_count_ + 1) { return; }
+		if (target > grain_count_) { return; }
 		if (param_name == gf_param_name::stream)
 		{
 			if (target < 1) { return; }
@@ -235,10 +643,9 @@ namespace Grainflow
 		grains_.get()[target - 1].param_set(value, param_name, param_type);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::param_set(const int target,
-	                                                                         const std::string& reflection_string,
-	                                                                         const float value)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::param_set(
+		const int target, const std::string& reflection_string, const float value)
 	{
 		gf_param_name param_name;
 		gf_param_type param_type;
@@ -250,8 +657,67 @@ namespace Grainflow
 		return GF_RETURN_CODE::GF_SUCCESS;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::channel_param_set(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::param_set(const int target,
+	                                                                                 const gf_param_handle handle,
+	                                                                                 const float value)
+	{
+		if (!handle.valid()) return GF_RETURN_CODE::GF_PARAM_NOT_FOUND;
+		param_set(target, handle.name, handle.type, value);
+		return GF_RETURN_CODE::GF_SUCCESS;
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::param_set(const gf_param_update* updates,
+	                                                                                 const int count)
+	{
+		// Broadcasts are gathered into a fixed buffer so batching never allocates and the grains are swept once per
+		// run of broadcasts. Targeted updates go straight to their grain, after any broadcast queued before them.
+		constexpr int chunk_size = 64;
+		gf_param_update broadcasts[chunk_size];
+		int n = 0;
+		const auto flush = [&]()
+		{
+			for (int g = 0; g < grain_count_; ++g)
+			{
+				for (int i = 0; i < n; ++i)
+				{
+					grains_[g].param_set(broadcasts[i].value, broadcasts[i].handle.name, broadcasts[i].handle.type);
+				}
+			}
+			n = 0;
+		};
+		auto result = GF_RETURN_CODE::GF_SUCCESS;
+		for (int i = 0; i < count; ++i)
+		{
+			auto update = updates[i];
+			if (!update.handle.valid())
+			{
+				result = GF_RETURN_CODE::GF_PARAM_NOT_FOUND;
+				continue;
+			}
+			if (update.target > grain_count_) continue;
+			if (update.handle.name == gf_param_name::stream)
+			{
+				if (update.target >= 1) stream_set(update.target - 1, static_cast<int>(update.value));
+				continue;
+			}
+			transform_params(update.handle.name, update.handle.type, update.value);
+			if (update.target > 0)
+			{
+				if (n > 0) flush();
+				grains_[update.target - 1].param_set(update.value, update.handle.name, update.handle.type);
+				continue;
+			}
+			broadcasts[n++] = update;
+			if (n == chunk_size) flush();
+		}
+		flush();
+		return result;
+	}
+
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::channel_param_set(
 		const int channel, const gf_param_name param_name,
 		const gf_param_type param_type,
 		const float value)
@@ -264,8 +730,8 @@ namespace Grainflow
 		}
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::channel_param_set(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::channel_param_set(
 		const int channel, const std::string& reflection_string,
 		const float value)
 	{
@@ -278,8 +744,8 @@ namespace Grainflow
 		return GF_RETURN_CODE::GF_SUCCESS;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::grain_param_func(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::grain_param_func(
 		const gf_param_name param_name, const gf_param_type param_type,
 		float (*func)(float, float, float), const float a, const float b)
 	{
@@ -291,8 +757,8 @@ namespace Grainflow
 		return GF_RETURN_CODE::GF_SUCCESS;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::grain_param_func(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::grain_param_func(
 		const std::string& reflection_string,
 		float (*func)(float, float, float),
 		const float a,
@@ -306,17 +772,17 @@ namespace Grainflow
 		return grain_param_func(param_name, param_type, func, a, b);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	float gf_grain_collection<T, Internalblock, SigType>::param_get(const int target, gf_param_name param_name)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	float gf_grain_collection<T, Internalblock, SigType, Reader>::param_get(const int target, gf_param_name param_name)
 	{
 		if (target >= grain_count_) return 0;
 		if (target <= 1) return grains_.get()[0].param_get(param_name);
 		return grains_.get()[target - 1].param_get(param_name);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	float gf_grain_collection<T, Internalblock, SigType>::param_get(const int target, gf_param_name param_name,
-	                                                                gf_param_type param_type)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	float gf_grain_collection<T, Internalblock, SigType, Reader>::param_get(const int target, gf_param_name param_name,
+	                                                                        gf_param_type param_type)
 	{
 		if (target > grain_count_) return 0;
 		if (target <= 1) return grains_.get()[0].param_get(param_name, param_type);
@@ -324,8 +790,8 @@ namespace Grainflow
 	}
 
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::set_active_grains(int n_grains)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::set_active_grains(int n_grains)
 	{
 		if (n_grains <= 0) n_grains = 0;
 		else if (n_grains > grain_count_) n_grains = grain_count_;
@@ -333,41 +799,43 @@ namespace Grainflow
 		const auto windowOffset = 1.0f / (n_grains > 0 ? n_grains : 1);
 		for (int g = 0; g < grain_count_; g++)
 		{
-			grains_[g].enabled = g < active_grains_;
-			if (auto_overlap_ && grains_[g].enabled)
+			const bool enabled = g < active_grains_;
+			grains_[g].enabled.store(enabled, std::memory_order_relaxed);
+			if (auto_overlap_ && enabled)
 			{
 				param_set(g + 1, gf_param_name::window, gf_param_type::offset, windowOffset);
 			}
 		}
+		active_generation_.fetch_add(1, std::memory_order_release);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	int gf_grain_collection<T, Internalblock, SigType>::active_grains() const
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	int gf_grain_collection<T, Internalblock, SigType, Reader>::active_grains() const
 	{
 		return active_grains_;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::set_auto_overlap(const bool auto_overlap)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::set_auto_overlap(const bool auto_overlap)
 	{
 		auto_overlap_ = auto_overlap;
 		set_active_grains(active_grains_);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	bool gf_grain_collection<T, Internalblock, SigType>::get_auto_overlap()
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	bool gf_grain_collection<T, Internalblock, SigType, Reader>::get_auto_overlap()
 	{
 		return auto_overlap_;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	int gf_grain_collection<T, Internalblock, SigType>::streams() const
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	int gf_grain_collection<T, Internalblock, SigType, Reader>::streams() const
 	{
 		return nstreams_;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::stream_param_set(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::stream_param_set(
 		int stream, const gf_param_name param_name,
 		const gf_param_type param_type,
 		const float value)
@@ -381,8 +849,8 @@ namespace Grainflow
 		return GF_RETURN_CODE::GF_SUCCESS;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::stream_param_set(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::stream_param_set(
 		const std::string& reflection_string, const int stream,
 		const float value)
 	{
@@ -394,8 +862,8 @@ namespace Grainflow
 		return stream_param_set(stream, param_name, param_type, value);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::stream_param_func(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::stream_param_func(
 		const gf_param_name param_name, const gf_param_type param_type,
 		float (*func)(float, float, float), const float a, const float b)
 	{
@@ -409,8 +877,8 @@ namespace Grainflow
 		return GF_RETURN_CODE::GF_SUCCESS;
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType>::stream_param_func(
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	GF_RETURN_CODE gf_grain_collection<T, Internalblock, SigType, Reader>::stream_param_func(
 		const std::string& reflection_string,
 		float (*func)(float, float, float),
 		const float a,
@@ -424,46 +892,46 @@ namespace Grainflow
 		return stream_param_func(param_name, param_type, func, a, b);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::stream_set(gf_stream_set_type mode, int nstreams)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::stream_set(gf_stream_set_type mode, int nstreams)
 	{
 		nstreams_ = nstreams;
 		if (mode == gf_stream_set_type::manual_streams) return;
 		for (int g = 0; g < grain_count_; g++)
 		{
-			grains_[g].stream_set(grain_count_, mode, nstreams);
+			grains_[g].stream_set(grain_count_, mode, nstreams, rng_);
 		}
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::stream_set(const int grain, int stream_id)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::stream_set(const int grain, int stream_id)
 	{
 		if (grain <= 0) return;
 		if (grain > grain_count_) return;
 		if (stream_id <= 0) return;
-		grains_[grain - 1].stream_set(stream_id, gf_stream_set_type::manual_streams, nstreams_);
+		grains_[grain - 1].stream_set(stream_id, gf_stream_set_type::manual_streams, nstreams_, rng_);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	int gf_grain_collection<T, Internalblock, SigType>::stream_get(int grain_index)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	int gf_grain_collection<T, Internalblock, SigType, Reader>::stream_get(int grain_index)
 	{
 		return static_cast<int>(grains_[grain_index].stream);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	T* gf_grain_collection<T, Internalblock, SigType>::get_buffer(gf_buffers type, int index)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	T* gf_grain_collection<T, Internalblock, SigType, Reader>::get_buffer(gf_buffers type, int index)
 	{
 		return grains_[index].get_buffer(type);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	int gf_grain_collection<T, Internalblock, SigType>::chanel_get(int index)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	int gf_grain_collection<T, Internalblock, SigType, Reader>::chanel_get(int index)
 	{
 		return grains_[index].channel();
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::channels_set_interleaved(const int channels)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::channels_set_interleaved(const int channels)
 	{
 		for (int g = 0; g < grain_count_; g++)
 		{
@@ -471,14 +939,14 @@ namespace Grainflow
 		}
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::channel_set(int index, const int channel)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::channel_set(int index, const int channel)
 	{
 		grains_[index].param_set(static_cast<float>(channel), gf_param_name::channel, gf_param_type::base);
 	}
 
-	template <typename T, size_t Internalblock, typename SigType>
-	void gf_grain_collection<T, Internalblock, SigType>::channel_mode_set(const int mode)
+	template <typename T, size_t Internalblock, typename SigType, typename Reader>
+	void gf_grain_collection<T, Internalblock, SigType, Reader>::channel_mode_set(const int mode)
 	{
 		for (int g = 0; g < grain_count_; g++)
 		{
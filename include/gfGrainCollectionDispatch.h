@@ -0,0 +1,388 @@
+#pragma once
+#include <memory>
+#include "gfGrainCollection.h"
+
+namespace Grainflow
+{
+	/// <summary>
+	/// Wraps gf_grain_collection instantiated for internal block sizes of 16, 32, 64, 128 and 256 samples and runs the
+	/// one that best fits the host block size. Call prepare() whenever the host block size changes, it allocates the
+	/// new collection and carries over every grain, parameter and buffer so playback continues where it left off.
+	/// All other calls are forwarded to the active collection.
+	/// </summary>
+	template <typename T, typename SigType = double, typename Reader = gf_i_buffer_reader<T, SigType>>
+	class gf_grain_collection_dispatch
+	{
+	private:
+		template <size_t Internalblock>
+		using collection_type = gf_grain_collection<T, Internalblock, SigType, Reader>;
+
+		std::unique_ptr<collection_type<16>> collection_16_;
+		std::unique_ptr<collection_type<32>> collection_32_;
+		std::unique_ptr<collection_type<64>> collection_64_;
+		std::unique_ptr<collection_type<128>> collection_128_;
+		std::unique_ptr<collection_type<256>> collection_256_;
+		int internal_block_ = 0;
+
+		template <typename F>
+		decltype(auto) visit(F&& func)
+		{
+			switch (internal_block_)
+			{
+			case 16:
+				return func(*collection_16_);
+			case 32:
+				return func(*collection_32_);
+			case 128:
+				return func(*collection_128_);
+			case 256:
+				return func(*collection_256_);
+			default:
+				return func(*collection_64_);
+			}
+		}
+
+		template <size_t Internalblock, size_t OtherInternalblock>
+		static void switch_to(std::unique_ptr<collection_type<Internalblock>>& target,
+		                      std::unique_ptr<collection_type<OtherInternalblock>>& source)
+		{
+			if constexpr (Internalblock == OtherInternalblock) return;
+			else
+			{
+				target = std::make_unique<collection_type<Internalblock>>(Reader{});
+				target->copy_state(*source);
+				source.reset();
+			}
+		}
+
+		template <size_t Internalblock>
+		void switch_from(std::unique_ptr<collection_type<Internalblock>>& source, const int block)
+		{
+			switch (block)
+			{
+			case 16:
+				switch_to(collection_16_, source);
+				break;
+			case 32:
+				switch_to(collection_32_, source);
+				break;
+			case 128:
+				switch_to(collection_128_, source);
+				break;
+			case 256:
+				switch_to(collection_256_, source);
+				break;
+			default:
+				switch_to(collection_64_, source);
+				break;
+			}
+		}
+
+	public:
+		explicit gf_grain_collection_dispatch(Reader buffer_reader, int grain_count = 0,
+		                                      int host_block_size = 64)
+		{
+			internal_block_ = select_internal_block(host_block_size);
+			switch (internal_block_)
+			{
+			case 16:
+				collection_16_ = std::make_unique<collection_type<16>>(buffer_reader, grain_count);
+				break;
+			case 32:
+				collection_32_ = std::make_unique<collection_type<32>>(buffer_reader, grain_count);
+				break;
+			case 128:
+				collection_128_ = std::make_unique<collection_type<128>>(buffer_reader, grain_count);
+				break;
+			case 256:
+				collection_256_ = std::make_unique<collection_type<256>>(buffer_reader, grain_count);
+				break;
+			default:
+				collection_64_ = std::make_unique<collection_type<64>>(buffer_reader, grain_count);
+				break;
+			}
+		}
+
+		/// @brief Picks the largest internal block that divides the host block, or the largest one that fits
+		/// when none of them divide it
+		static int select_internal_block(const int host_block_size)
+		{
+			constexpr int sizes[] = {256, 128, 64, 32, 16};
+			for (const auto size : sizes)
+			{
+				if (host_block_size >= size && host_block_size % size == 0) return size;
+			}
+			for (const auto size : sizes)
+			{
+				if (host_block_size >= size) return size;
+			}
+			return 16;
+		}
+
+		/// @brief Switches to the best internal block size for a host block size. When the block size changes this
+		/// allocates a new collection and destroys the one process() uses, so it must not be called while process()
+		/// runs.
+		void prepare(const int host_block_size)
+		{
+			const int block = select_internal_block(host_block_size);
+			if (block == internal_block_) return;
+			switch (internal_block_)
+			{
+			case 16:
+				switch_from(collection_16_, block);
+				break;
+			case 32:
+				switch_from(collection_32_, block);
+				break;
+			case 128:
+				switch_from(collection_128_, block);
+				break;
+			case 256:
+				switch_from(collection_256_, block);
+				break;
+			default:
+				switch_from(collection_64_, block);
+				break;
+			}
+			internal_block_ = block;
+		}
+
+		[[nodiscard]] int internal_block() const
+		{
+			return internal_block_;
+		}
+
+		void process(gf_io_config<SigType>& io_config)
+		{
+			visit([&](auto& collection) { collection.process(io_config); });
+		}
+
+		void resize(const int grain_count)
+		{
+			visit([&](auto& collection) { collection.resize(grain_count); });
+		}
+
+		[[nodiscard]] int grains()
+		{
+			return visit([](auto& collection) { return collection.grains(); });
+		}
+
+		void set_samplerate(const int samplerate)
+		{
+			visit([&](auto& collection) { collection.samplerate = samplerate; });
+		}
+
+		void set_thread_pool(gf_thread_pool* thread_pool, const int grains_per_chunk = 16)
+		{
+			visit([&](auto& collection) { collection.set_thread_pool(thread_pool, grains_per_chunk); });
+		}
+
+		void prepare_bus(const int bus_chans, const int max_block_size)
+		{
+			visit([&](auto& collection) { collection.prepare_bus(bus_chans, max_block_size); });
+		}
+
+		void seed(const std::uint64_t seed)
+		{
+			visit([&](auto& collection) { collection.seed(seed); });
+		}
+
+		void reset_state()
+		{
+			visit([&](auto& collection) { collection.reset_state(); });
+		}
+
+		void set_internal_clock(const int channels, const float rate = 1, const int max_block_size = 512)
+		{
+			visit([&](auto& collection) { collection.set_internal_clock(channels, rate, max_block_size); });
+		}
+
+		void set_internal_traversal(const int channels, const float rate = 0, const int max_block_size = 512)
+		{
+			visit([&](auto& collection) { collection.set_internal_traversal(channels, rate, max_block_size); });
+		}
+
+		void clock_rate_set(const int target, const float rate)
+		{
+			visit([&](auto& collection) { collection.clock_rate_set(target, rate); });
+		}
+
+		void clock_phase_set(const int target, const float phase)
+		{
+			visit([&](auto& collection) { collection.clock_phase_set(target, phase); });
+		}
+
+		void traversal_rate_set(const int target, const float rate)
+		{
+			visit([&](auto& collection) { collection.traversal_rate_set(target, rate); });
+		}
+
+		void traversal_phase_set(const int target, const float phase)
+		{
+			visit([&](auto& collection) { collection.traversal_phase_set(target, phase); });
+		}
+
+		void param_set(const int target, const gf_param_name param_name, const gf_param_type param_type,
+		               const float value)
+		{
+			visit([&](auto& collection) { collection.param_set(target, param_name, param_type, value); });
+		}
+
+		GF_RETURN_CODE param_set(const int target, const std::string& reflection_string, const float value)
+		{
+			return visit([&](auto& collection) { return collection.param_set(target, reflection_string, value); });
+		}
+
+		GF_RETURN_CODE param_set(const int target, const gf_param_handle handle, const float value)
+		{
+			return visit([&](auto& collection) { return collection.param_set(target, handle, value); });
+		}
+
+		GF_RETURN_CODE param_set(const gf_param_update* updates, const int count)
+		{
+			return visit([&](auto& collection) { return collection.param_set(updates, count); });
+		}
+
+		void channel_param_set(const int channel, const gf_param_name param_name, const gf_param_type param_type,
+		                       const float value)
+		{
+			visit([&](auto& collection) { collection.channel_param_set(channel, param_name, param_type, value); });
+		}
+
+		GF_RETURN_CODE channel_param_set(const int channel, const std::string& reflection_string, const float value)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.channel_param_set(channel, reflection_string, value);
+			});
+		}
+
+		GF_RETURN_CODE grain_param_func(const gf_param_name param_name, const gf_param_type param_type,
+		                                float (*func)(float, float, float), const float a, const float b)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.grain_param_func(param_name, param_type, func, a, b);
+			});
+		}
+
+		GF_RETURN_CODE grain_param_func(const std::string& reflection_string, float (*func)(float, float, float),
+		                                const float a, const float b)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.grain_param_func(reflection_string, func, a, b);
+			});
+		}
+
+		float param_get(const int target, const gf_param_name param_name)
+		{
+			return visit([&](auto& collection) { return collection.param_get(target, param_name); });
+		}
+
+		float param_get(const int target, const gf_param_name param_name, const gf_param_type param_type)
+		{
+			return visit([&](auto& collection) { return collection.param_get(target, param_name, param_type); });
+		}
+
+		void set_active_grains(const int n_grains)
+		{
+			visit([&](auto& collection) { collection.set_active_grains(n_grains); });
+		}
+
+		[[nodiscard]] int active_grains()
+		{
+			return visit([](auto& collection) { return collection.active_grains(); });
+		}
+
+		void set_auto_overlap(const bool auto_overlap)
+		{
+			visit([&](auto& collection) { collection.set_auto_overlap(auto_overlap); });
+		}
+
+		bool get_auto_overlap()
+		{
+			return visit([](auto& collection) { return collection.get_auto_overlap(); });
+		}
+
+		GF_RETURN_CODE set_buffer(const gf_buffers type, T* ref, const int target)
+		{
+			return visit([&](auto& collection) { return collection.set_buffer(type, ref, target); });
+		}
+
+		GF_RETURN_CODE set_buffer(const std::string& reflection_string, T* ref, const int target)
+		{
+			return visit([&](auto& collection) { return collection.set_buffer(reflection_string, ref, target); });
+		}
+
+		T* get_buffer(const gf_buffers type, const int index = 0)
+		{
+			return visit([&](auto& collection) { return collection.get_buffer(type, index); });
+		}
+
+		[[nodiscard]] int streams()
+		{
+			return visit([](auto& collection) { return collection.streams(); });
+		}
+
+		GF_RETURN_CODE stream_param_set(const int stream, const gf_param_name param_name,
+		                                const gf_param_type param_type, const float value)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.stream_param_set(stream, param_name, param_type, value);
+			});
+		}
+
+		GF_RETURN_CODE stream_param_set(const std::string& reflection_string, const int stream, const float value)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.stream_param_set(reflection_string, stream, value);
+			});
+		}
+
+		GF_RETURN_CODE stream_param_func(const gf_param_name param_name, const gf_param_type param_type,
+		                                 float (*func)(float, float, float), const float a, const float b)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.stream_param_func(param_name, param_type, func, a, b);
+			});
+		}
+
+		GF_RETURN_CODE stream_param_func(const std::string& reflection_string, float (*func)(float, float, float),
+		                                 const float a, const float b)
+		{
+			return visit([&](auto& collection)
+			{
+				return collection.stream_param_func(reflection_string, func, a, b);
+			});
+		}
+
+		void stream_set(const gf_stream_set_type mode, const int nstreams)
+		{
+			visit([&](auto& collection) { collection.stream_set(mode, nstreams); });
+		}
+
+		void stream_set(const int grain, const int stream_id)
+		{
+			visit([&](auto& collection) { collection.stream_set(grain, stream_id); });
+		}
+
+		void channels_set_interleaved(const int channels)
+		{
+			visit([&](auto& collection) { collection.channels_set_interleaved(channels); });
+		}
+
+		void channel_set(const int index, const int channel)
+		{
+			visit([&](auto& collection) { collection.channel_set(index, channel); });
+		}
+
+		void channel_mode_set(const int mode)
+		{
+			visit([&](auto& collection) { collection.channel_mode_set(mode); });
+		}
+	};
+}
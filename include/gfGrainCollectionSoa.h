@@ -0,0 +1,1054 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+#include "gfParam.h"
+#include "gfUtils.h"
+#include "gfIBufferReader.h"
+#include "gfIoConfig.h"
+#include "gfSyn.h"
+#include "gfEnvelopes.h"
+#include "gfRandom.h"
+
+namespace Grainflow
+{
+	/// <summary>
+	/// A grain collection that keeps its grain state as a structure of arrays.
+	/// Grains are processed in groups of Lanes. The per sample work (grain clock, reset detection, playback increment
+	/// and envelope lookup) runs across the grains of a group in vector lanes instead of one grain at a time.
+	/// Inputs, outputs and parameters behave like gf_grain_collection, glisson buffers are sampled per grain.
+	/// </summary>
+	template <typename T, size_t Internalblock, typename SigType = double, size_t Lanes = 8,
+	          typename Reader = gf_i_buffer_reader<T, SigType>>
+	class gf_grain_collection_soa
+	{
+	private:
+		static constexpr SigType Grainclock_Thresh = 1e-7;
+		static constexpr int n_params = static_cast<int>(gf_param_name::vibrato_depth);
+		static constexpr int n_buffers = static_cast<int>(gf_buffers::glisson_buffer) + 1;
+		static constexpr size_t Laneblock = Internalblock * Lanes;
+
+		Reader buffer_reader_;
+		int grain_count_ = 0;
+		int padded_count_ = 0;
+		int active_grains_ = 0;
+		int nstreams_ = 0;
+		bool auto_overlap_ = true;
+
+		// Cold state, only touched when a grain resets or a parameter is set
+		std::vector<gf_param> params_[n_params];
+		// Parameter writes land in the shadows and are applied to params_ at the start of a block
+		std::unique_ptr<gf_param_shadow[]> shadows_[n_params];
+		std::atomic<bool> param_pending_[n_params]{};
+		std::vector<T*> buffers_[n_buffers];
+		std::vector<gf_buffer_info> buffer_info_;
+		// Normalized buffer position each grain started from, reported through gf_grain_meta
+		std::vector<float> start_position_;
+		// One generator per grain, loaded into a gf_rng while the grain resets
+		gf_rng_bank grain_rng_;
+		// Used for control side draws such as random stream assignment
+		gf_rng rng_;
+		std::uint64_t seed_ = 0;
+		bool seeded_ = false;
+
+		// Hot state, read and written every block
+		std::vector<SigType> source_sample_;
+		std::vector<SigType> last_grain_clock_;
+		std::vector<SigType> vibrato_phase_;
+		std::vector<int> stream_;
+		// Written by set_active_grains() from the control thread
+		std::unique_ptr<std::atomic<std::uint8_t>[]> enabled_;
+		std::vector<std::uint8_t> enabled_internal_;
+		std::vector<std::uint8_t> window_changed_;
+		std::vector<std::uint8_t> grain_enabled_;
+
+		// Scratch laid out as [sample][lane]
+		alignas(64) SigType progress_[Laneblock];
+		alignas(64) SigType state_[Laneblock];
+		alignas(64) SigType delta_[Laneblock];
+		alignas(64) SigType positions_[Laneblock];
+		alignas(64) SigType vibrato_phase_temp_[Laneblock];
+		alignas(64) SigType vibrato_[Laneblock];
+		alignas(64) SigType glisson_shape_[Laneblock];
+		alignas(64) SigType envelope_[Laneblock];
+		// Scratch for calls into the buffer reader which expects one grain at a time
+		alignas(64) SigType row_temp_[Internalblock];
+		// Stands in for the grain output rows when the host only asked for bus outputs
+		alignas(64) SigType row_scratch_[8][Internalblock];
+
+		inline gf_param& param(const gf_param_name param_name, const int g)
+		{
+			return params_[static_cast<int>(param_name) - 1][g];
+		}
+
+		inline gf_param_shadow& shadow(const gf_param_name param_name, const int g)
+		{
+			return shadows_[static_cast<int>(param_name) - 1][g];
+		}
+
+		/// @brief Row g of an output at block, or a scratch row when the host did not ask for grain rows
+		inline SigType* grain_row(SigType** rows, const gf_io_config<SigType>& io_config, const int g,
+		                          const int block, const int scratch)
+		{
+			return io_config.writes(rows) ? &rows[g][block] : row_scratch_[scratch];
+		}
+
+		/// @brief Row of a lane gathered from [sample][lane] scratch when there are no grain rows to read it from
+		inline SigType* lane_row(SigType** rows, const gf_io_config<SigType>& io_config, const SigType* lanes,
+		                         const int g, const size_t l, const int block, const int size, const int scratch)
+		{
+			if (io_config.writes(rows)) return &rows[g][block];
+			for (int j = 0; j < size; ++j)
+			{
+				row_scratch_[scratch][j] = lanes[j * Lanes + l];
+			}
+			return row_scratch_[scratch];
+		}
+
+		/// @brief Applies parameter writes made since the last block, called from the audio thread
+		void apply_param_updates()
+		{
+			for (int p = 0; p < n_params; ++p)
+			{
+				if (!param_pending_[p].load(std::memory_order_relaxed)) continue;
+				if (!param_pending_[p].exchange(false, std::memory_order_acquire)) continue;
+				for (int g = 0; g < grain_count_; ++g)
+				{
+					shadows_[p][g].apply(params_[p][g]);
+				}
+			}
+		}
+
+		/// @brief Makes the values sampled for a grain visible to param_get
+		void publish_values(const int g)
+		{
+			for (int p = 0; p < n_params; ++p)
+			{
+				shadows_[p][g].current.store(params_[p][g].value, std::memory_order_relaxed);
+			}
+		}
+
+		/// @brief Draws a new value for every masked lane of a group in one pass, value = u * random + base + offset * g
+		void sample_lanes(const gf_param_name param_name, const int first, const std::uint8_t* mask)
+		{
+			float u[Lanes];
+			grain_rng_.uniform(u, first, Lanes, mask);
+			gf_param* __restrict params = &params_[static_cast<int>(param_name) - 1][first];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const float sampled = u[l] * params[l].random + params[l].base + params[l].offset * static_cast<float>(
+					first + l);
+				params[l].value = mask[l] ? sampled : params[l].value;
+			}
+		}
+
+		/// @brief Samples a parameter that can read from a buffer. Masked lanes in a buffer mode read the buffer and
+		/// only draw when the read fails, the rest draw in one pass, so each grain draws as often as gf_grain does
+		void sample_lanes(const gf_param_name param_name, const gf_buffers buffer, const int first,
+		                  const std::uint8_t* mask)
+		{
+			std::uint8_t draw_mask[Lanes];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				auto& lane_param = param(param_name, g);
+				draw_mask[l] = mask[l] && lane_param.mode == gf_buffer_mode::normal;
+				if (!mask[l] || draw_mask[l]) continue;
+				auto rng = grain_rng_.load(g);
+				if (!buffer_reader_.sample_param_buffer(buffers_[static_cast<int>(buffer)][g], &lane_param, g, rng))
+				{
+					lane_param.value = rng.uniform() * lane_param.random + lane_param.base + lane_param.offset *
+						static_cast<float>(g);
+				}
+				grain_rng_.store(g, rng);
+			}
+			sample_lanes(param_name, first, draw_mask);
+		}
+
+		/// @brief Samples the parameters of every grain in a group that crossed zero in this block. Each parameter is
+		/// drawn for all lanes at once, lanes that did not reset keep their values. Lanes whose parameter reads from a
+		/// buffer are sampled per grain.
+		void reset_lanes(gf_io_config<SigType>& io_config, const int first, const int block, const std::uint8_t* mask,
+		                 const SigType* reset_position)
+		{
+			sample_lanes(gf_param_name::delay, gf_buffers::delay_buffer, first, mask);
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				if (!mask[l]) continue;
+				const int g = first + static_cast<int>(l);
+				const auto& info = buffer_info_[g];
+				const SigType* traversal = &io_config.traversal_phasor[g % io_config.traversal_phasor_chans][block];
+				const auto position = traversal[static_cast<int>(reset_position[l])] * info.buffer_frames - (param(
+					gf_param_name::delay, g).value * 0.001f * buffer_samplerate) - 1;
+				source_sample_[g] = gf_utils::mod<SigType>(position, info.buffer_frames);
+				start_position_[g] = info.buffer_frames > 0
+					                     ? static_cast<float>(source_sample_[g] / info.buffer_frames)
+					                     : 0.0f;
+			}
+
+			sample_lanes(gf_param_name::rate, gf_buffers::rate_buffer, first, mask);
+			gf_param* __restrict rate = &params_[static_cast<int>(gf_param_name::rate) - 1][first];
+			const gf_param* __restrict quantize = &params_[static_cast<int>(gf_param_name::rate_quantize_semi) - 1][
+				first];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				if (!mask[l]) continue;
+				rate[l].value = 1 + gf_utils::round(rate[l].value - 1, 1 - quantize[l].value);
+			}
+
+			// A grain whose window changed skips one grain and keeps its window
+			std::uint8_t window_mask[Lanes];
+			float last_window[Lanes];
+			gf_param* __restrict window = &params_[static_cast<int>(gf_param_name::window) - 1][first];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				window_mask[l] = mask[l] && !window_changed_[first + l];
+				last_window[l] = window[l].value;
+			}
+			sample_lanes(gf_param_name::window, gf_buffers::window_buffer, first, window_mask);
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const bool changed = std::abs(window[l].value - last_window[l]) > 0.00000001;
+				window_changed_[first + l] = mask[l] ? changed : window_changed_[first + l];
+			}
+
+			sample_lanes(gf_param_name::space, first, mask);
+			sample_lanes(gf_param_name::glisson, first, mask);
+			sample_lanes(gf_param_name::envelope_position, first, mask);
+			sample_lanes(gf_param_name::amplitude, first, mask);
+			sample_lanes(gf_param_name::start_point, first, mask);
+			sample_lanes(gf_param_name::stop_point, first, mask);
+			sample_lanes(gf_param_name::glisson_position, first, mask);
+			sample_lanes(gf_param_name::vibrato_rate, first, mask);
+			sample_lanes(gf_param_name::vibrato_depth, first, mask);
+
+			float u[Lanes];
+			grain_rng_.uniform(u, first, Lanes, mask);
+			gf_param* __restrict channel = &params_[static_cast<int>(gf_param_name::channel) - 1][first];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				if (!mask[l]) continue;
+				const float range = buffer_info_[first + l].n_channels;
+				channel[l].value = gf_utils::mod((u[l] * channel[l].random + channel[l].offset) * range + channel[l].
+				                                 base, range);
+			}
+
+			grain_rng_.uniform(u, first, Lanes, mask);
+			const gf_param* __restrict density = &params_[static_cast<int>(gf_param_name::density) - 1][first];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				grain_enabled_[first + l] = mask[l] ? density[l].base > u[l] : grain_enabled_[first + l];
+			}
+
+			// Only a direction base strictly between -1 and 1 is random, the others do not draw
+			gf_param* __restrict direction = &params_[static_cast<int>(gf_param_name::direction) - 1][first];
+			std::uint8_t direction_mask[Lanes];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				direction_mask[l] = mask[l] && direction[l].base > -1 && direction[l].base < 1;
+			}
+			grain_rng_.uniform(u, first, Lanes, direction_mask);
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const float base = direction[l].base;
+				const float sampled = base >= 1 ? 1.0f : base <= -1 ? -1.0f : u[l] > base ? -1.0f : 1.0f;
+				direction[l].value = mask[l] ? sampled : direction[l].value;
+			}
+
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				if (!mask[l]) continue;
+				enabled_internal_[first + l] = enabled_[first + l].load(std::memory_order_relaxed);
+				publish_values(first + static_cast<int>(l));
+			}
+		}
+
+		/// @brief Processes Lanes grains starting at first over the whole host block
+		void process_group(gf_io_config<SigType>& io_config, const int first)
+		{
+			bool lane_active[Lanes];
+			bool any_active = false;
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				lane_active[l] = g < grain_count_ &&
+					(enabled_[g].load(std::memory_order_relaxed) || enabled_internal_[g]);
+				any_active |= lane_active[l];
+			}
+			int reset_offset[Lanes];
+			std::fill_n(reset_offset, Lanes, -1);
+			if (!any_active)
+			{
+				write_meta(io_config, first, reset_offset);
+				return;
+			}
+
+			bool buffer_valid[Lanes];
+			bool use_default_envelope[Lanes];
+			SigType window_val[Lanes];
+			SigType window_portion[Lanes];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				buffer_valid[l] = false;
+				use_default_envelope[l] = true;
+				if (lane_active[l])
+				{
+					// Grains usually share a buffer so the info is only refreshed when it changes
+					const auto buffer = buffers_[static_cast<int>(gf_buffers::buffer)][g];
+					if (l > 0 && lane_active[l - 1] && buffer == buffers_[static_cast<int>(gf_buffers::buffer)][g - 1])
+					{
+						buffer_valid[l] = buffer_valid[l - 1];
+						buffer_info_[g] = buffer_info_[g - 1];
+					}
+					else
+					{
+						buffer_valid[l] = buffer_reader_.update_buffer_info(buffer, io_config, &buffer_info_[g]);
+					}
+					gf_buffer_info envelope_info;
+					use_default_envelope[l] = !buffer_reader_.update_buffer_info(
+						buffers_[static_cast<int>(gf_buffers::envelope)][g], io_config, &envelope_info);
+				}
+				window_val[l] = param(gf_param_name::window, g).value;
+				window_portion[l] = 1 / std::min(std::max(1.0f - param(gf_param_name::space, g).value, 0.0001f),
+				                                 1.0f);
+			}
+
+			// The last block is shorter when the host block is not a multiple of Internalblock
+			for (int block = 0; block < io_config.block_size; block += static_cast<int>(Internalblock))
+			{
+				const int size = std::min(static_cast<int>(Internalblock), io_config.block_size - block);
+				process_block(io_config, first, block, size, lane_active, buffer_valid, use_default_envelope,
+				              window_val, window_portion, reset_offset);
+			}
+			write_meta(io_config, first, reset_offset);
+		}
+
+		/// @brief Fills the block metadata of the grains of a group
+		void write_meta(gf_io_config<SigType>& io_config, const int first, const int* reset_offset)
+		{
+			if (io_config.grain_meta == nullptr) return;
+			for (size_t l = 0; l < Lanes && first + static_cast<int>(l) < grain_count_; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				auto& meta = io_config.grain_meta[g];
+				meta.stream = stream_[g] + 1;
+				meta.buffer_channel = static_cast<int>(param(gf_param_name::channel, g).value) + 1;
+				meta.reset_offset = reset_offset[l];
+				meta.start_position = start_position_[g];
+				meta.rate = param(gf_param_name::rate, g).value;
+				meta.amplitude = param(gf_param_name::amplitude, g).value;
+			}
+		}
+
+		void process_block(gf_io_config<SigType>& io_config, const int first, const int block, const int size,
+		                   const bool* lane_active, const bool* buffer_valid, const bool* use_default_envelope,
+		                   const SigType* window_val, const SigType* window_portion, int* reset_offset)
+		{
+			// Tail blocks shorter than Internalblock only fill the first size rows of the lane scratch
+			const size_t lane_samples = static_cast<size_t>(size) * Lanes;
+
+			// Gather the grain clocks into lanes and convert them to grain progress
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const SigType* grain_clock = &io_config.grain_clock[(first + l) % io_config.grain_clock_chans][block];
+				for (int j = 0; j < size; ++j)
+				{
+					progress_[j * Lanes + l] = grain_clock[j];
+				}
+			}
+			for (int j = 0; j < size; ++j)
+			{
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					auto sample = progress_[j * Lanes + l] + window_val[l];
+					sample -= gf_utils::fast_floor(sample);
+					sample *= window_portion[l];
+					progress_[j * Lanes + l] = sample < 1.0 ? sample : 1.0;
+				}
+			}
+
+			// Reset detection across lanes, masks are kept as SigType so the loop stays in vector registers
+			SigType grain_reset[Lanes];
+			SigType reset_position[Lanes];
+			SigType last_reset[Lanes];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const auto last = last_grain_clock_[first + l];
+				const auto clock = progress_[l];
+				const bool reset = (last > clock && clock >= Grainclock_Thresh) || (last < Grainclock_Thresh && clock >
+					Grainclock_Thresh);
+				grain_reset[l] = reset ? 1.0 : 0.0;
+				state_[l] = !reset && clock >= Grainclock_Thresh ? 1.0 : 0.0;
+				reset_position[l] = 0;
+				last_reset[l] = reset ? 0.0 : -1.0;
+			}
+			for (int j = 1; j < size; ++j)
+			{
+				const SigType index = j;
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					const auto prev = progress_[(j - 1) * Lanes + l];
+					const auto clock = progress_[j * Lanes + l];
+					const bool above = clock >= Grainclock_Thresh;
+					const bool zero_cross = (prev > clock && above) || (prev <= Grainclock_Thresh && clock >
+						Grainclock_Thresh);
+					state_[j * Lanes + l] = !zero_cross && above ? 1.0 : 0.0;
+					reset_position[l] = grain_reset[l] > 0 && zero_cross ? index : reset_position[l];
+					grain_reset[l] = zero_cross ? 1.0 : grain_reset[l];
+					last_reset[l] = zero_cross ? index : last_reset[l];
+				}
+			}
+
+			// Cold path, grains that reset sample new parameters together
+			std::uint8_t reset_mask[Lanes];
+			bool any_reset = false;
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				reset_mask[l] = lane_active[l] && grain_reset[l] > 0;
+				any_reset |= reset_mask[l] != 0;
+				reset_offset[l] = reset_mask[l] ? block + static_cast<int>(last_reset[l]) : reset_offset[l];
+				if (!lane_active[l]) continue;
+				last_grain_clock_[g] = enabled_internal_[g] ? progress_[(size - 1) * Lanes + l] : 0.001;
+			}
+			if (any_reset) reset_lanes(io_config, first, block, reset_mask, reset_position);
+
+			// Per lane constants for this block
+			bool lane_playing[Lanes];
+			bool any_playing = false;
+			bool any_vibrato = false;
+			SigType rate_scale[Lanes];
+			SigType glisson[Lanes];
+			SigType vibrato_depth[Lanes];
+			SigType vibrato_increment[Lanes];
+			SigType start[Lanes];
+			SigType end[Lanes];
+			SigType wrap[Lanes];
+			int fold[Lanes];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				const auto& info = buffer_info_[g];
+				lane_playing[l] = lane_active[l] && enabled_internal_[g] && !window_changed_[g];
+				any_playing |= lane_playing[l];
+
+				rate_scale[l] = info.sample_rate_adjustment * param(gf_param_name::rate, g).value * param(
+					gf_param_name::direction, g).value;
+				glisson[l] = param(gf_param_name::glisson, g).value;
+				const auto vibrato_rate = param(gf_param_name::vibrato_rate, g).value;
+				const auto depth = param(gf_param_name::vibrato_depth, g).value;
+				const bool vibrato = vibrato_rate > 0.0f && depth > 0.0f;
+				any_vibrato |= lane_playing[l] && vibrato;
+				vibrato_depth[l] = vibrato ? depth * 0.5f : 0.0f;
+				vibrato_increment[l] = vibrato ? static_cast<SigType>(vibrato_rate) / samplerate : 0.0;
+
+				const double start_tmp = std::min(static_cast<double>(info.buffer_frames) * param(
+					                                  gf_param_name::start_point, g).value,
+				                                  static_cast<double>(info.buffer_frames));
+				const double end_tmp = std::min(static_cast<double>(info.buffer_frames) * param(
+					                                gf_param_name::stop_point, g).value,
+				                                static_cast<double>(info.buffer_frames));
+				start[l] = std::min(start_tmp, end_tmp);
+				end[l] = std::max(start_tmp, end_tmp);
+				wrap[l] = info.buffer_frames * 2.0;
+				fold[l] = param(gf_param_name::loop_mode, g).base > 1.1f ? 1 : 0;
+			}
+
+			// Grains that are off or changing window only report their state
+			const bool state_rows = io_config.writes(io_config.grain_progress) || io_config.writes(io_config.grain_state);
+			for (size_t l = 0; l < Lanes && state_rows; ++l)
+			{
+				if (!lane_active[l] || lane_playing[l]) continue;
+				const int g = first + static_cast<int>(l);
+				SigType* grain_progress = grain_row(io_config.grain_progress, io_config, g, block, 0);
+				SigType* grain_state = grain_row(io_config.grain_state, io_config, g, block, 1);
+				std::fill_n(grain_progress, size, 0.0);
+				if (!enabled_internal_[g])
+				{
+					std::fill_n(grain_state, size, 0.0);
+					continue;
+				}
+				for (int j = 0; j < size; ++j)
+				{
+					grain_state[j] = state_[j * Lanes + l];
+				}
+			}
+			if (!any_playing) return;
+			for (size_t l = 0; l < Lanes && state_rows; ++l)
+			{
+				if (!lane_playing[l]) continue;
+				const int g = first + static_cast<int>(l);
+				SigType* grain_progress = grain_row(io_config.grain_progress, io_config, g, block, 0);
+				SigType* grain_state = grain_row(io_config.grain_state, io_config, g, block, 1);
+				for (int j = 0; j < size; ++j)
+				{
+					grain_progress[j] = progress_[j * Lanes + l];
+					grain_state[j] = state_[j * Lanes + l];
+				}
+			}
+
+			// Playback increment across lanes, control rate fm only needs one exp2f per lane
+			bool fm_constant = !any_vibrato;
+			for (size_t l = 0; l < Lanes && fm_constant; ++l)
+			{
+				const SigType* fm = &io_config.fm[(first + l) % io_config.fm_chans][block];
+				fm_constant = io_config.fm_scalar || gf_utils::is_constant(fm, size);
+			}
+			if (fm_constant)
+			{
+				SigType rate[Lanes];
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					rate[l] = gf_utils::pitch_to_rate(
+						static_cast<float>(io_config.fm[(first + l) % io_config.fm_chans][block]));
+				}
+				for (int j = 0; j < size; ++j)
+				{
+					for (size_t l = 0; l < Lanes; ++l)
+					{
+						delta_[j * Lanes + l] = rate[l];
+					}
+				}
+			}
+			else
+			{
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					const SigType* fm = &io_config.fm[(first + l) % io_config.fm_chans][block];
+					for (int j = 0; j < size; ++j)
+					{
+						delta_[j * Lanes + l] = fm[j];
+					}
+				}
+			}
+			if (any_vibrato)
+			{
+				for (int j = 0; j < size; ++j)
+				{
+					for (size_t l = 0; l < Lanes; ++l)
+					{
+						auto phase = vibrato_phase_[first + l] + vibrato_increment[l] * j;
+						vibrato_phase_temp_[j * Lanes + l] = phase - gf_utils::fast_floor(phase);
+					}
+				}
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					const auto phase = vibrato_phase_[first + l] + vibrato_increment[l] * size;
+					vibrato_phase_[first + l] = lane_playing[l] ? phase - std::floor(phase) : vibrato_phase_[first + l];
+				}
+				GfSyn::ChevyshevSin<SigType, static_cast<long>(Laneblock)>(vibrato_, vibrato_phase_temp_);
+				for (int j = 0; j < size; ++j)
+				{
+					for (size_t l = 0; l < Lanes; ++l)
+					{
+						delta_[j * Lanes + l] += vibrato_[j * Lanes + l] * vibrato_depth[l];
+					}
+				}
+			}
+			if (!fm_constant)
+			{
+				for (size_t i = 0; i < lane_samples; ++i)
+				{
+					delta_[i] = gf_utils::pitch_to_rate(static_cast<float>(delta_[i]));
+				}
+			}
+
+			// Glisson buffers are read per grain, the normal mode is a flat shape
+			std::fill_n(glisson_shape_, lane_samples, 1.0);
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				const int g = first + static_cast<int>(l);
+				const auto& glisson_param = param(gf_param_name::glisson, g);
+				const auto rows = param(gf_param_name::glisson_rows, g).value;
+				if (!lane_playing[l] || (glisson_param.mode == gf_buffer_mode::normal && rows >= 1)) continue;
+				buffer_reader_.sample_envelope(buffers_[static_cast<int>(gf_buffers::glisson_buffer)][g], false,
+				                               static_cast<int>(rows), param(gf_param_name::glisson_position, g).value,
+				                               row_temp_, lane_row(io_config.grain_progress, io_config, progress_, g, l,
+				                                                   block, size, 0), size);
+				for (int j = 0; j < size; ++j)
+				{
+					glisson_shape_[j * Lanes + l] = row_temp_[j];
+				}
+			}
+			for (int j = 0; j < size; ++j)
+			{
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					delta_[j * Lanes + l] *= rate_scale[l] * (1 + glisson_shape_[j * Lanes + l] * glisson[l] *
+						progress_[j * Lanes + l]);
+				}
+			}
+
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				positions_[l] = source_sample_[first + l];
+			}
+			for (int j = 1; j < size; ++j)
+			{
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					positions_[j * Lanes + l] = positions_[(j - 1) * Lanes + l] + delta_[(j - 1) * Lanes + l];
+				}
+			}
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				if (!lane_playing[l] || start[l] == end[l]) continue;
+				source_sample_[first + l] = gf_utils::mod<SigType>(
+					positions_[(size - 1) * Lanes + l] + delta_[(size - 1) * Lanes + l], wrap[l]);
+			}
+			// Branch free gf_utils::pong so the fold runs across lanes
+			SigType range[Lanes];
+			SigType fold_range[Lanes];
+			SigType fold_offset[Lanes];
+			SigType fold_sign[Lanes];
+			SigType range_mask[Lanes];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				range_mask[l] = start[l] == end[l] ? 0.0 : 1.0;
+				range[l] = start[l] == end[l] ? 1.0 : end[l] - start[l];
+				fold_range[l] = range[l] * (fold[l] + 1);
+				fold_offset[l] = range[l] * fold[l];
+				fold_sign[l] = 1 - fold[l] * 2;
+			}
+			for (int j = 0; j < size; ++j)
+			{
+				for (size_t l = 0; l < Lanes; ++l)
+				{
+					const auto a = positions_[j * Lanes + l] - start[l];
+					auto wrapped = a - fold_range[l] * gf_utils::fast_floor(a / fold_range[l]);
+					wrapped = wrapped < 0.0 ? 0.0 : wrapped;
+					wrapped = wrapped > fold_range[l] ? fold_range[l] : wrapped;
+					const auto folded = fold_offset[l] + fold_sign[l] * std::abs(wrapped - fold_offset[l]);
+					positions_[j * Lanes + l] = start[l] + folded * range_mask[l];
+				}
+			}
+
+			// Default envelope across lanes
+			for (size_t i = 0; i < lane_samples; ++i)
+			{
+				auto position = progress_[i] * 1024.0;
+				position = position < 1023.0 ? position : 1023.0;
+				position = position > 0.0 ? position : 0.0;
+				envelope_[i] = gf_envelopes::hanning_envelope[static_cast<int>(position)];
+			}
+
+			// Scatter each lane back to its grain rows
+			const auto output = output_lanes[io_config.report_mask()];
+			for (size_t l = 0; l < Lanes; ++l)
+			{
+				if (!lane_playing[l]) continue;
+				const int g = first + static_cast<int>(l);
+				(this->*output)(io_config, g, l, block, size, buffer_valid[l], use_default_envelope[l]);
+			}
+		}
+
+		/// @brief Writes the outputs of one lane, report outputs missing from Report are not computed
+		template <unsigned Report>
+		void output_lane(gf_io_config<SigType>& io_config, const int g, const size_t l, const int block,
+		                 const int size, const bool buffer_valid, const bool use_default_envelope)
+		{
+			const auto& info = buffer_info_[g];
+			const SigType* input_amp = &io_config.am[g % io_config.am_chans][block];
+			SigType* grain_progress = lane_row(io_config.grain_progress, io_config, progress_, g, l, block, size, 0);
+			SigType* grain_state = lane_row(io_config.grain_state, io_config, state_, g, l, block, size, 1);
+			SigType* grain_playhead = grain_row(io_config.grain_playhead, io_config, g, block, 2);
+			SigType* grain_amp = grain_row(io_config.grain_amp, io_config, g, block, 3);
+			SigType* grain_envelope = grain_row(io_config.grain_envelope, io_config, g, block, 4);
+			SigType* grain_output = grain_row(io_config.grain_output, io_config, g, block, 5);
+			SigType* grain_channels = grain_row(io_config.grain_buffer_channel, io_config, g, block, 6);
+			SigType* grain_streams = grain_row(io_config.grain_stream_channel, io_config, g, block, 7);
+
+			if (use_default_envelope)
+			{
+				for (int j = 0; j < size; ++j)
+				{
+					grain_envelope[j] = envelope_[j * Lanes + l];
+				}
+			}
+			else
+			{
+				buffer_reader_.sample_envelope(buffers_[static_cast<int>(gf_buffers::envelope)][g], false,
+				                               static_cast<int>(param(gf_param_name::n_envelopes, g).value),
+				                               param(gf_param_name::envelope_position, g).value, grain_envelope,
+				                               grain_progress, size);
+			}
+
+			for (int j = 0; j < size; ++j)
+			{
+				row_temp_[j] = positions_[j * Lanes + l];
+			}
+			if (row_temp_[0] != row_temp_[0]) return; // Nan check
+			if (buffer_valid)
+			{
+				buffer_reader_.sample_buffer(buffers_[static_cast<int>(gf_buffers::buffer)][g],
+				                             static_cast<int>(param(gf_param_name::channel, g).value), grain_output,
+				                             row_temp_, size, param(gf_param_name::start_point, g).value,
+				                             param(gf_param_name::stop_point, g).value);
+			}
+
+			const float amplitude = param(gf_param_name::amplitude, g).value;
+			const float density = grain_enabled_[g] ? 1.0f : 0.0f;
+			const SigType stream = stream_[g] + 1;
+			const SigType channel = static_cast<int>(param(gf_param_name::channel, g).value) + 1;
+			if (io_config.am_scalar || gf_utils::is_constant(input_amp, size))
+			{
+				const SigType am_gain = (1 - input_amp[0]) * amplitude;
+				for (int j = 0; j < size; ++j)
+				{
+					grain_amp[j] = am_gain * (density * grain_state[j]);
+				}
+			}
+			else
+			{
+				for (int j = 0; j < size; ++j)
+				{
+					grain_amp[j] = (1 - input_amp[j]) * amplitude * (density * grain_state[j]);
+				}
+			}
+			for (int j = 0; j < size; ++j)
+			{
+				const SigType sample_density = density * grain_state[j];
+				if constexpr ((Report & gf_report_playhead) != 0)
+					grain_playhead[j] = row_temp_[j] * info.one_over_buffer_frames * sample_density;
+				grain_envelope[j] *= sample_density;
+				grain_output[j] *= grain_amp[j] * 0.5 * grain_envelope[j];
+				if constexpr ((Report & gf_report_stream_channel) != 0)
+					grain_streams[j] = stream;
+				if constexpr ((Report & gf_report_buffer_channel) != 0)
+					grain_channels[j] = channel;
+			}
+			if (io_config.bus_output != nullptr && io_config.bus_chans > 0)
+			{
+				SigType* bus = &io_config.bus_output[io_config.bus_index(stream_[g], static_cast<int>(channel) - 1)][
+					block];
+				for (int j = 0; j < size; ++j)
+				{
+					bus[j] += grain_output[j];
+				}
+			}
+		}
+
+		using output_lane_func = decltype(&gf_grain_collection_soa::output_lane<gf_report_all>);
+		// Indexed by gf_io_config::report_mask() so the choice is made once per block rather than per sample
+		static constexpr output_lane_func output_lanes[gf_report_all + 1] = {
+			&gf_grain_collection_soa::output_lane<0>, &gf_grain_collection_soa::output_lane<1>,
+			&gf_grain_collection_soa::output_lane<2>, &gf_grain_collection_soa::output_lane<3>,
+			&gf_grain_collection_soa::output_lane<4>, &gf_grain_collection_soa::output_lane<5>,
+			&gf_grain_collection_soa::output_lane<6>, &gf_grain_collection_soa::output_lane<7>,
+		};
+
+	public:
+		int samplerate = 48000;
+		/// Converts the delay parameter from milliseconds to frames, the counterpart of gf_grain::buffer_samplerate
+		int buffer_samplerate = 48000;
+
+		explicit gf_grain_collection_soa(Reader buffer_reader, const int grain_count = 0)
+			: progress_{}, state_{}, delta_{}, positions_{}, vibrato_phase_temp_{}, vibrato_{}, glisson_shape_{}, envelope_{}, row_temp_{},
+			  row_scratch_{}
+		{
+			buffer_reader_ = buffer_reader;
+			if (grain_count > 0)
+			{
+				resize(grain_count);
+			}
+		}
+
+		void resize(const int grain_count)
+		{
+			grain_count_ = std::max(grain_count, 0);
+			padded_count_ = static_cast<int>((grain_count_ + Lanes - 1) / Lanes * Lanes);
+
+			for (int p = 0; p < n_params; ++p)
+			{
+				params_[p].assign(padded_count_, gf_param{});
+			}
+			for (int g = 0; g < padded_count_; ++g)
+			{
+				param(gf_param_name::rate, g).base = 1;
+				param(gf_param_name::amplitude, g).base = 1;
+				param(gf_param_name::direction, g).base = 1;
+				param(gf_param_name::stop_point, g).base = 1;
+				param(gf_param_name::stop_point, g).value = 1;
+				param(gf_param_name::rate_quantize_semi, g).value = 1;
+				param(gf_param_name::n_envelopes, g).value = 1;
+				param(gf_param_name::glisson_rows, g).value = 1;
+				param(gf_param_name::density, g).base = 1;
+			}
+			for (int p = 0; p < n_params; ++p)
+			{
+				shadows_[p] = std::make_unique<gf_param_shadow[]>(padded_count_);
+				for (int g = 0; g < padded_count_; ++g)
+				{
+					shadows_[p][g].reset(params_[p][g]);
+				}
+				param_pending_[p].store(false);
+			}
+			for (auto& buffers : buffers_)
+			{
+				buffers.assign(padded_count_, nullptr);
+			}
+			buffer_info_.assign(padded_count_, gf_buffer_info{});
+			start_position_.assign(padded_count_, 0);
+			grain_rng_.resize(padded_count_);
+			grain_rng_.seed(seeded_ ? seed_ : gf_rng::next_default_seed());
+			source_sample_.assign(padded_count_, 0);
+			last_grain_clock_.assign(padded_count_, -999);
+			vibrato_phase_.assign(padded_count_, 0);
+			stream_.assign(padded_count_, 0);
+			enabled_.reset(new std::atomic<std::uint8_t>[padded_count_]);
+			for (int g = 0; g < padded_count_; ++g)
+			{
+				enabled_[g].store(0, std::memory_order_relaxed);
+			}
+			enabled_internal_.assign(padded_count_, 0);
+			window_changed_.assign(padded_count_, 0);
+			grain_enabled_.assign(padded_count_, 1);
+			set_active_grains(grain_count_);
+		}
+
+		[[nodiscard]] int grains() const
+		{
+			return grain_count_;
+		}
+
+		/// @brief Gives every grain its own generator derived from seed and its index, so the random values a grain
+		/// draws do not depend on processing order. The seed is kept across resize().
+		void seed(const std::uint64_t seed)
+		{
+			seed_ = seed;
+			seeded_ = true;
+			rng_.seed(gf_rng::derive_seed(seed, ~0ull));
+			grain_rng_.seed(seed);
+		}
+
+		/// @brief Returns every grain to its initial playback state and reseeds it when a seed was set. Rendering the
+		/// same inputs after reset_state() reproduces the same output. Must not be called while processing.
+		void reset_state()
+		{
+			apply_param_updates();
+			if (seeded_) seed(seed_);
+			std::fill(source_sample_.begin(), source_sample_.end(), 0);
+			std::fill(start_position_.begin(), start_position_.end(), 0);
+			std::fill(last_grain_clock_.begin(), last_grain_clock_.end(), -999);
+			std::fill(vibrato_phase_.begin(), vibrato_phase_.end(), 0);
+			std::fill(enabled_internal_.begin(), enabled_internal_.end(), 0);
+			std::fill(window_changed_.begin(), window_changed_.end(), 0);
+			std::fill(grain_enabled_.begin(), grain_enabled_.end(), 1);
+			for (int p = 0; p < n_params; ++p)
+			{
+				for (int g = 0; g < grain_count_; ++g)
+				{
+					params_[p][g].value = shadows_[p][g].value.load(std::memory_order_relaxed);
+				}
+			}
+			for (int g = 0; g < grain_count_; ++g)
+			{
+				publish_values(g);
+			}
+		}
+
+		// Processes all grain given an io config with the correct inputs and outputs
+		void process(gf_io_config<SigType>& io_config)
+		{
+			apply_param_updates();
+			if (io_config.block_size < 1) return;
+			// Grains add into the buses which hold their sum once every group is processed
+			for (int ch = 0; io_config.bus_output != nullptr && ch < io_config.bus_chans; ++ch)
+			{
+				std::fill_n(io_config.bus_output[ch], io_config.block_size, 0.0);
+			}
+			// Like gf_grain, skip the block when the host passed the same row for the first two clocks
+			if (io_config.grain_clock_chans > 1 && io_config.grain_clock[0] == io_config.grain_clock[1]) return;
+			for (int first = 0; first < grain_count_; first += static_cast<int>(Lanes))
+			{
+				process_group(io_config, first);
+			}
+		}
+
+		void param_set(const int target, gf_param_name param_name, const gf_param_type param_type, float value)
+		{
+			if (target > grain_count_) { return; }
+			if (param_name == gf_param_name::stream)
+			{
+				if (target < 1) { return; }
+				stream_set(target, static_cast<int>(value));
+				return;
+			}
+			param_transform(param_name, param_type, value);
+			if (param_name == gf_param_name::ERR || static_cast<int>(param_name) > n_params) return;
+			const int first = target <= 0 ? 0 : target - 1;
+			const int last = target <= 0 ? grain_count_ : target;
+			for (int g = first; g < last; ++g)
+			{
+				shadow(param_name, g).set(param_type, value);
+			}
+			param_pending_[static_cast<int>(param_name) - 1].store(true, std::memory_order_release);
+		}
+
+		GF_RETURN_CODE param_set(const int target, const std::string& reflection_string, const float value)
+		{
+			gf_param_name param_name;
+			gf_param_type param_type;
+			if (!param_reflection(reflection_string, param_name, param_type))
+				return GF_RETURN_CODE::GF_PARAM_NOT_FOUND;
+			param_set(target, param_name, param_type, value);
+			return GF_RETURN_CODE::GF_SUCCESS;
+		}
+
+		GF_RETURN_CODE param_set(const int target, const gf_param_handle handle, const float value)
+		{
+			if (!handle.valid()) return GF_RETURN_CODE::GF_PARAM_NOT_FOUND;
+			param_set(target, handle.name, handle.type, value);
+			return GF_RETURN_CODE::GF_SUCCESS;
+		}
+
+		/// @brief Applies a batch of updates in order, parameters are stored per field so each update is one pass
+		/// over contiguous grains
+		GF_RETURN_CODE param_set(const gf_param_update* updates, const int count)
+		{
+			auto result = GF_RETURN_CODE::GF_SUCCESS;
+			for (int i = 0; i < count; ++i)
+			{
+				if (param_set(updates[i].target, updates[i].handle, updates[i].value) != GF_RETURN_CODE::GF_SUCCESS)
+					result = GF_RETURN_CODE::GF_PARAM_NOT_FOUND;
+			}
+			return result;
+		}
+
+		float param_get(const int target, const gf_param_name param_name, const gf_param_type param_type)
+		{
+			if (target > grain_count_ || grain_count_ == 0) return 0;
+			if (param_name == gf_param_name::ERR || static_cast<int>(param_name) > n_params) return 0;
+			if (param_type == gf_param_type::mode) return 0;
+			return shadow(param_name, target <= 1 ? 0 : target - 1).get(param_type);
+		}
+
+		float param_get(const int target, const gf_param_name param_name)
+		{
+			return param_get(target, param_name, gf_param_type::value);
+		}
+
+		void set_active_grains(int n_grains)
+		{
+			if (n_grains <= 0) n_grains = 0;
+			else if (n_grains > grain_count_) n_grains = grain_count_;
+			active_grains_ = n_grains;
+			const auto window_offset = 1.0f / (n_grains > 0 ? n_grains : 1);
+			for (int g = 0; g < grain_count_; g++)
+			{
+				const bool enabled = g < active_grains_;
+				enabled_[g].store(enabled, std::memory_order_relaxed);
+				if (auto_overlap_ && enabled)
+				{
+					shadow(gf_param_name::window, g).set(gf_param_type::offset, window_offset);
+				}
+			}
+			param_pending_[static_cast<int>(gf_param_name::window) - 1].store(true, std::memory_order_release);
+		}
+
+		[[nodiscard]] int active_grains() const
+		{
+			return active_grains_;
+		}
+
+		void set_auto_overlap(const bool auto_overlap)
+		{
+			auto_overlap_ = auto_overlap;
+			set_active_grains(active_grains_);
+		}
+
+		bool get_auto_overlap()
+		{
+			return auto_overlap_;
+		}
+
+		GF_RETURN_CODE set_buffer(const gf_buffers type, T* ref, const int target)
+		{
+			if (target > grain_count_) return GF_RETURN_CODE::GF_ERR;
+			auto& buffers = buffers_[static_cast<int>(type)];
+			if (target == 0)
+			{
+				std::fill(buffers.begin(), buffers.end(), ref);
+				return GF_RETURN_CODE::GF_SUCCESS;
+			}
+			buffers[target - 1] = ref;
+			return GF_RETURN_CODE::GF_SUCCESS;
+		}
+
+		GF_RETURN_CODE set_buffer(const std::string& reflection_string, T* ref, const int target)
+		{
+			gf_buffers type;
+			if (!buffer_reflection(reflection_string, type)) return GF_RETURN_CODE::GF_ERR;
+			return set_buffer(type, ref, target);
+		}
+
+		T* get_buffer(const gf_buffers type, const int index = 0)
+		{
+			return buffers_[static_cast<int>(type)][index];
+		}
+
+		[[nodiscard]] int streams() const
+		{
+			return nstreams_;
+		}
+
+		void stream_set(const gf_stream_set_type mode, const int nstreams)
+		{
+			nstreams_ = nstreams;
+			if (mode == gf_stream_set_type::manual_streams || nstreams <= 0) return;
+			for (int g = 0; g < grain_count_; g++)
+			{
+				switch (mode)
+				{
+				case gf_stream_set_type::automatic_streams:
+					stream_[g] = g % nstreams;
+					break;
+				case gf_stream_set_type::per_streams:
+					stream_[g] = g / nstreams;
+					break;
+				case gf_stream_set_type::random_streams:
+					stream_[g] = rng_.below(nstreams);
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		void stream_set(const int grain, const int stream_id)
+		{
+			if (grain <= 0 || grain > grain_count_ || stream_id <= 0 || nstreams_ <= 1) return;
+			stream_[grain - 1] = (stream_id - 1 + nstreams_) % (nstreams_ - 1);
+		}
+
+		int stream_get(const int grain_index)
+		{
+			return stream_[grain_index];
+		}
+
+		void channels_set_interleaved(const int channels)
+		{
+			for (int g = 0; g < grain_count_; g++)
+			{
+				param_set(g + 1, gf_param_name::channel, gf_param_type::base, static_cast<float>(g % channels));
+			}
+		}
+
+		void channel_set(const int index, const int channel)
+		{
+			param_set(index + 1, gf_param_name::channel, gf_param_type::base, static_cast<float>(channel));
+		}
+
+		void channel_mode_set(const int mode)
+		{
+			for (int g = 0; g < grain_count_; g++)
+			{
+				param_set(g + 1, gf_param_name::channel, gf_param_type::random, static_cast<float>(mode));
+			}
+		}
+	};
+}
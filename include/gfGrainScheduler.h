@@ -0,0 +1,256 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include "gfGrainCollection.h"
+#include "gfRandom.h"
+
+namespace Grainflow
+{
+	/// @brief A grain that starts at an absolute sample time of a gf_grain_scheduler and lasts length samples
+	struct gf_grain_event
+	{
+		std::int64_t time = 0;
+		int length = 0;
+	};
+
+	/// <summary>
+	/// Plays grains from trigger events instead of per grain clock inputs.
+	/// Grains are voices of a preallocated gf_grain_collection. A voice is taken from the free pool when its event
+	/// starts, is driven by an internal clock ramp that runs once over the grain length, and goes back to the pool
+	/// at the end of the block in which the ramp finishes. Only sounding voices are processed, so the cost follows
+	/// the number of overlapping grains rather than the pool size.
+	/// Events come from trigger() or from the built in generator set up with set_density().
+	/// The grain_clock inputs of the io config are ignored, the other inputs are used as usual and every output
+	/// needs one row per voice. Rows of voices that are not sounding are not written. With bus outputs and
+	/// grain_rows off only the buses are needed.
+	/// Events that start when every voice is busy are dropped and counted.
+	/// </summary>
+	template <typename T, size_t Internalblock, typename SigType = double,
+	          typename Reader = gf_i_buffer_reader<T, SigType>>
+	class gf_grain_scheduler
+	{
+	private:
+		gf_grain_collection<T, Internalblock, SigType, Reader> voices_;
+		int voice_count_ = 0;
+
+		// Pending events kept as a min heap on time, the capacity is fixed at construction
+		std::vector<gf_grain_event> events_;
+		size_t event_capacity_ = 0;
+
+		std::vector<int> free_voices_;
+		std::vector<int> active_voices_;
+		std::vector<gf_grain_event> voice_events_;
+
+		// One clock row per voice, at least two rows so grains can compare the first two row pointers
+		std::vector<SigType> clock_storage_;
+		std::vector<SigType*> clock_rows_;
+		int block_capacity_ = 0;
+
+		std::int64_t time_ = 0;
+		int dropped_events_ = 0;
+
+		float density_ = 0;
+		float density_jitter_ = 0;
+		float length_ms_ = 50;
+		float length_random_ms_ = 0;
+		double next_generated_ = 0;
+		gf_rng rng_;
+
+		static bool later(const gf_grain_event& a, const gf_grain_event& b)
+		{
+			return a.time > b.time;
+		}
+
+		[[nodiscard]] int length_in_samples(const float length_ms) const
+		{
+			return std::max(static_cast<int>(std::lround(length_ms * 0.001 * samplerate)), 1);
+		}
+
+		void generate_events(const std::int64_t block_end)
+		{
+			if (density_ <= 0) return;
+			const double period = samplerate / static_cast<double>(density_);
+			while (next_generated_ < static_cast<double>(block_end))
+			{
+				const float length = length_ms_ + length_random_ms_ * rng_.uniform();
+				if (!trigger(static_cast<std::int64_t>(next_generated_), length)) ++dropped_events_;
+				next_generated_ += std::max(period * (1 + density_jitter_ * (rng_.uniform() * 2 - 1)), 1.0);
+			}
+		}
+
+		void start_voices(const std::int64_t block_end)
+		{
+			while (!events_.empty() && events_.front().time < block_end)
+			{
+				std::pop_heap(events_.begin(), events_.end(), later);
+				auto event = events_.back();
+				events_.pop_back();
+				if (free_voices_.empty())
+				{
+					++dropped_events_;
+					continue;
+				}
+				const int voice = free_voices_.back();
+				free_voices_.pop_back();
+				event.time = std::max(event.time, time_);
+				voice_events_[voice] = event;
+				active_voices_.push_back(voice);
+			}
+		}
+
+		/// @brief Writes the clock ramp of a voice for this block, zero outside of the grain
+		void write_clock(const int voice, const int block_size)
+		{
+			const auto& event = voice_events_[voice];
+			SigType* clock = clock_rows_[voice];
+			const auto begin = static_cast<int>(std::clamp<std::int64_t>(event.time - time_, 0, block_size));
+			const auto end = static_cast<int>(std::clamp<std::int64_t>(event.time + event.length - time_, 0,
+			                                                           block_size));
+			const SigType increment = static_cast<SigType>(1) / event.length;
+			const auto first = static_cast<SigType>(time_ + begin - event.time + 1);
+			std::fill_n(clock, begin, 0.0);
+			for (int j = begin; j < end; ++j)
+			{
+				clock[j] = (first + (j - begin)) * increment;
+			}
+			std::fill_n(clock + end, block_size - end, 0.0);
+		}
+
+	public:
+		int samplerate = 48000;
+
+		/// @param voices the number of grains that can sound at once
+		/// @param max_events the number of pending events that can be queued
+		/// @param max_block_size the largest host block expected, larger blocks allocate on first use
+		gf_grain_scheduler(Reader buffer_reader, const int voices, const int max_events = 1024,
+		                   const int max_block_size = 512) : voices_(buffer_reader, std::max(voices, 1))
+		{
+			voice_count_ = std::max(voices, 1);
+			voices_.set_auto_overlap(false);
+			voices_.set_active_grains(voice_count_);
+			event_capacity_ = static_cast<size_t>(std::max(max_events, 1));
+			events_.reserve(event_capacity_);
+			free_voices_.reserve(voice_count_);
+			for (int v = voice_count_ - 1; v >= 0; --v)
+			{
+				free_voices_.push_back(v);
+			}
+			active_voices_.reserve(voice_count_);
+			voice_events_.assign(voice_count_, gf_grain_event{});
+			prepare(max_block_size);
+		}
+
+		/// @brief The voice pool, use it to set parameters, buffers, streams and the thread pool
+		gf_grain_collection<T, Internalblock, SigType, Reader>& voices()
+		{
+			return voices_;
+		}
+
+		/// @brief Allocates clock rows for blocks of up to max_block_size samples, call outside of the audio thread
+		void prepare(const int max_block_size)
+		{
+			block_capacity_ = std::max(max_block_size, 1);
+			const int rows = std::max(voice_count_, 2);
+			clock_storage_.assign(static_cast<size_t>(rows) * block_capacity_, 0);
+			clock_rows_.resize(rows);
+			for (int r = 0; r < rows; ++r)
+			{
+				clock_rows_[r] = &clock_storage_[static_cast<size_t>(r) * block_capacity_];
+			}
+		}
+
+		/// @brief Queues a grain at an absolute sample time, times before now() start at the next block.
+		/// Call from the thread that calls process().
+		/// @return false when the event queue is full
+		bool trigger(const std::int64_t time, const float length_ms)
+		{
+			if (events_.size() >= event_capacity_) return false;
+			events_.push_back({time, length_in_samples(length_ms)});
+			std::push_heap(events_.begin(), events_.end(), later);
+			return true;
+		}
+
+		/// @brief Queues a grain offset samples after the start of the next block
+		bool trigger_in(const int offset, const float length_ms)
+		{
+			return trigger(time_ + offset, length_ms);
+		}
+
+		/// @brief Generates grains at a steady rate. Each interval is scaled by a random factor in
+		/// [1 - jitter, 1 + jitter]. A density of zero stops the generator.
+		void set_density(const float grains_per_second, const float jitter = 0)
+		{
+			if (density_ <= 0) next_generated_ = static_cast<double>(time_);
+			density_ = std::max(grains_per_second, 0.0f);
+			density_jitter_ = std::clamp(jitter, 0.0f, 1.0f);
+		}
+
+		/// @brief Sets the length of generated grains to length_ms plus up to random_ms
+		void set_length(const float length_ms, const float random_ms = 0)
+		{
+			length_ms_ = std::max(length_ms, 0.0f);
+			length_random_ms_ = std::max(random_ms, 0.0f);
+		}
+
+		/// @brief Seeds the generator and every voice
+		void seed(const std::uint64_t seed)
+		{
+			rng_.seed(gf_rng::derive_seed(seed, ~1ull));
+			voices_.seed(seed);
+		}
+
+		/// @return the sample time at the start of the next block
+		[[nodiscard]] std::int64_t now() const
+		{
+			return time_;
+		}
+
+		[[nodiscard]] int active_voices() const
+		{
+			return static_cast<int>(active_voices_.size());
+		}
+
+		/// @return the number of events dropped because the queue was full or every voice was busy
+		[[nodiscard]] int dropped_events() const
+		{
+			return dropped_events_;
+		}
+
+		void process(gf_io_config<SigType>& io_config)
+		{
+			const int block_size = io_config.block_size;
+			if (block_size < 1) return;
+			if (block_size > block_capacity_) prepare(block_size);
+
+			const std::int64_t block_end = time_ + block_size;
+			generate_events(block_end);
+			start_voices(block_end);
+			for (const int voice : active_voices_)
+			{
+				write_clock(voice, block_size);
+			}
+
+			auto voice_config = io_config;
+			voice_config.grain_clock = clock_rows_.data();
+			voice_config.grain_clock_chans = static_cast<int>(clock_rows_.size());
+			voices_.process(voice_config, active_voices_.data(), static_cast<int>(active_voices_.size()));
+
+			// Voices whose ramp finished in this block go back to the pool
+			int size = 0;
+			for (const int voice : active_voices_)
+			{
+				const auto& event = voice_events_[voice];
+				if (event.time + event.length <= block_end)
+				{
+					free_voices_.push_back(voice);
+					continue;
+				}
+				active_voices_[size++] = voice;
+			}
+			active_voices_.resize(size);
+			time_ = block_end;
+		}
+	};
+}
@@ -19,7 +19,7 @@ namespace Grainflow
 	struct gf_i_buffer_reader
 	{
 	public:
-		bool (*sample_param_buffer)(T* buffer, gf_param* param, int grain_id) = nullptr;
+		bool (*sample_param_buffer)(T* buffer, gf_param* param, int grain_id, gf_rng& rng) = nullptr;
 		void (*sample_buffer)(T* buffer, int channel, SigType* __restrict samples, const SigType* positions,
 		                      const int size, const float lower_bound, const float upper_bound) = nullptr;
 		bool (*update_buffer_info)(T* buffer, const gf_io_config<SigType>& io_config, gf_buffer_info* buffer_info) =
@@ -0,0 +1,329 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include "gfUtils.h"
+#include "gfSimd.h"
+
+namespace Grainflow
+{
+	/// @brief How a grain reads between buffer frames, ordered from cheapest to highest quality
+	enum class gf_interpolation
+	{
+		// Two frames, the original grainflow interpolation
+		linear = 0,
+		// Four frames, 4 point 3rd order Hermite
+		hermite = 1,
+		// gf_sinc_table::taps frames, Kaiser windowed sinc
+		sinc = 2,
+	};
+
+	/// <summary>
+	/// Kaiser windowed sinc coefficients for gf_interpolation::sinc, one row of taps for each of phases fractional
+	/// positions between two frames. Coefficients between rows are interpolated linearly with the stored deltas.
+	/// The table is shared by every reader of the same sample type and is built on first use, call get() before
+	/// audio starts to keep the build off the audio thread.
+	/// </summary>
+	template <typename T>
+	class gf_sinc_table
+	{
+	public:
+		static constexpr int taps = 16;
+		static constexpr int phases = 256;
+		// Tap k of a row reads the frame first + k - offset, where first is the frame at or before the position
+		static constexpr int offset = taps / 2 - 1;
+
+		/// @brief Row p holds the taps for a fractional position of p / phases
+		std::array<T, phases * taps> coefficients{};
+		/// @brief Row p holds the difference between rows p + 1 and p
+		std::array<T, phases * taps> deltas{};
+
+		static const gf_sinc_table& get()
+		{
+			static const gf_sinc_table table;
+			return table;
+		}
+
+	private:
+		static constexpr double kaiser_beta = 10;
+		static constexpr double cutoff = 0.9;
+
+		/// @brief Zeroth order modified Bessel function of the first kind
+		static double bessel_i0(const double x)
+		{
+			double sum = 1;
+			double term = 1;
+			for (int k = 1; k < 32; ++k)
+			{
+				term *= (x / (2 * k)) * (x / (2 * k));
+				sum += term;
+			}
+			return sum;
+		}
+
+		/// @brief The taps for a fractional position, normalised so a constant signal passes unchanged
+		static void build_row(double* row, const double fraction)
+		{
+			constexpr double pi = 3.14159265358979323846;
+			const double half_width = taps / 2.0;
+			double sum = 0;
+			for (int k = 0; k < taps; ++k)
+			{
+				const double distance = (k - offset) - fraction;
+				const double x = pi * cutoff * distance;
+				const double sinc = std::abs(x) < 1e-12 ? 1.0 : std::sin(x) / x;
+				const double ratio = std::min(std::abs(distance) / half_width, 1.0);
+				const double window = bessel_i0(kaiser_beta * std::sqrt(1 - ratio * ratio)) / bessel_i0(kaiser_beta);
+				row[k] = sinc * window;
+				sum += row[k];
+			}
+			for (int k = 0; k < taps; ++k)
+			{
+				row[k] /= sum;
+			}
+		}
+
+		gf_sinc_table()
+		{
+			double row[taps];
+			double next[taps];
+			build_row(row, 0);
+			for (int p = 0; p < phases; ++p)
+			{
+				build_row(next, static_cast<double>(p + 1) / phases);
+				for (int k = 0; k < taps; ++k)
+				{
+					coefficients[p * taps + k] = static_cast<T>(row[k]);
+					deltas[p * taps + k] = static_cast<T>(next[k] - row[k]);
+				}
+				std::copy_n(next, taps, row);
+			}
+		}
+	};
+
+	/// <summary>
+	/// Reads a buffer channel at fractional frame positions with one of the gf_interpolation kernels.
+	/// Frames are read from data[frame * stride] so planar (stride 1) and interleaved (stride = channels) buffers both
+	/// work. Frames past upper_frame continue from lower_frame and frames before lower_frame continue from
+	/// upper_frame, so taps are continuous across the loop of a grain. Frames outside [0, max_frame] are never read.
+	/// Samples whose taps are all inside the loop read their frames directly, only samples next to an end of the loop
+	/// take the wrapping path. The sinc taps of a sample are contiguous, so each sample is one vector dot product over
+	/// its tap row. Linear and Hermite stay scalar, without a gather instruction collecting their frames into rows
+	/// for block wide vector arithmetic costs more than it saves.
+	/// </summary>
+	class gf_interpolator
+	{
+	private:
+		/// @brief The frame step frames away from first, wrapped around the loop when the step crosses an end of it
+		static inline int tap_frame(const int first, const int step, const int lower_frame, const int upper_frame,
+		                            const int max_frame)
+		{
+			const int length = upper_frame - lower_frame + 1;
+			int frame = first + step;
+			frame -= length * (frame > upper_frame && first <= upper_frame);
+			frame += length * (frame < lower_frame && first >= lower_frame);
+			return std::clamp(frame, 0, max_frame);
+		}
+
+		/// @brief The first frames whose taps from first - before to first + after can be read without wrapping.
+		/// A loop over the whole buffer can also read guard frames past either end directly.
+		static inline void direct_range(const int before, const int after, const int lower_frame,
+		                                const int upper_frame, const int max_frame, const int guard,
+		                                int& inside_lower, int& inside_upper)
+		{
+			if (lower_frame == 0 && upper_frame == max_frame && max_frame >= guard && guard >= std::max(before, after))
+			{
+				inside_lower = 0;
+				inside_upper = max_frame;
+				return;
+			}
+			inside_lower = std::max(lower_frame, 0) + before;
+			inside_upper = std::min(upper_frame, max_frame) - after;
+		}
+
+		/// @brief Splits a fractional position into a sinc table row and the fraction between it and the next row
+		template <typename T>
+		static inline int sinc_phase(const T fraction, T& phase_fraction)
+		{
+			const T phase = fraction * static_cast<T>(gf_sinc_table<T>::phases);
+			const int row = std::clamp(static_cast<int>(phase), 0, gf_sinc_table<T>::phases - 1);
+			phase_fraction = phase - static_cast<T>(row);
+			return row;
+		}
+
+		/// @brief Sums frames[k] * (coefficients[k] + phase_fraction * deltas[k]) over the taps of a sinc row
+		template <typename T>
+		static inline T sinc_dot(const T* __restrict frames, const T* __restrict coefficients,
+		                         const T* __restrict deltas, const T phase_fraction)
+		{
+			constexpr int taps = gf_sinc_table<T>::taps;
+			if constexpr (gf_simd<T>::enabled && taps % gf_simd<T>::width == 0)
+			{
+				using simd = gf_simd<T>;
+				const auto fraction = simd::set1(phase_fraction);
+				auto sum = simd::set1(0);
+				for (int k = 0; k < taps; k += simd::width)
+				{
+					const auto coefficient = simd::add(simd::load(coefficients + k),
+					                                   simd::mul(fraction, simd::load(deltas + k)));
+					sum = simd::add(sum, simd::mul(simd::load(frames + k), coefficient));
+				}
+				alignas(32) T lanes[simd::width];
+				simd::store(lanes, sum);
+				T result = lanes[0];
+				for (int l = 1; l < simd::width; ++l)
+				{
+					result += lanes[l];
+				}
+				return result;
+			}
+			else
+			{
+				T result = 0;
+				for (int k = 0; k < taps; ++k)
+				{
+					result += frames[k] * (coefficients[k] + phase_fraction * deltas[k]);
+				}
+				return result;
+			}
+		}
+
+	public:
+		/// @brief Scalar reference for interpolate. Linear and Hermite match it exactly, sinc adds its taps in a
+		/// different order and matches to within rounding.
+		template <gf_interpolation Mode, typename T>
+		static void interpolate_reference(const T* data, const int stride, T* __restrict out,
+		                                  const T* __restrict positions, const int size, const int lower_frame,
+		                                  const int upper_frame, const int max_frame)
+		{
+			for (int i = 0; i < size; ++i)
+			{
+				const auto first = static_cast<int>(positions[i]);
+				const T tween = positions[i] - first;
+				if constexpr (Mode == gf_interpolation::linear)
+				{
+					const bool frame_overflow = first >= upper_frame;
+					const int second = (first + 1) * !frame_overflow + lower_frame * frame_overflow;
+					out[i] = data[first * stride] * (1 - tween) + data[second * stride] * tween;
+				}
+				else if constexpr (Mode == gf_interpolation::hermite)
+				{
+					T frames[4];
+					for (int k = 0; k < 4; ++k)
+					{
+						frames[k] = data[tap_frame(first, k - 1, lower_frame, upper_frame, max_frame) * stride];
+					}
+					out[i] = gf_utils::cubic_hermite(frames[0], frames[1], frames[2], frames[3], tween);
+				}
+				else
+				{
+					using table = gf_sinc_table<T>;
+					const auto& sinc = table::get();
+					T phase_fraction;
+					const int row = sinc_phase(tween, phase_fraction);
+					T sum = 0;
+					for (int k = 0; k < table::taps; ++k)
+					{
+						const auto frame = tap_frame(first, k - table::offset, lower_frame, upper_frame, max_frame);
+						const auto index = row * table::taps + k;
+						sum += data[frame * stride] * (sinc.coefficients[index] + phase_fraction * sinc.deltas[index]);
+					}
+					out[i] = sum;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Reads size samples at frame positions into out. Linear matches the original grainflow reader exactly,
+		/// including the frame it reads after the last frame of the loop.
+		/// guard is the number of frames before the first and after the last frame of data that hold copies of the
+		/// other end of the buffer, as in gf_buffer_storage.
+		/// </summary>
+		template <gf_interpolation Mode, typename T>
+		static void interpolate(const T* data, const int stride, T* __restrict out, const T* __restrict positions,
+		                        const int size, const int lower_frame, const int upper_frame, const int max_frame,
+		                        const int guard = 0)
+		{
+			if constexpr (Mode == gf_interpolation::linear)
+			{
+				interpolate_reference<Mode>(data, stride, out, positions, size, lower_frame, upper_frame, max_frame);
+			}
+			else if constexpr (Mode == gf_interpolation::hermite)
+			{
+				int inside_lower;
+				int inside_upper;
+				direct_range(1, 2, lower_frame, upper_frame, max_frame, guard, inside_lower, inside_upper);
+				for (int i = 0; i < size; ++i)
+				{
+					const auto first = static_cast<int>(positions[i]);
+					const T tween = positions[i] - first;
+					if (first >= inside_lower && first <= inside_upper)
+					{
+						const T* frame = data + first * stride;
+						out[i] = gf_utils::cubic_hermite(frame[-stride], frame[0], frame[stride], frame[2 * stride],
+						                                 tween);
+						continue;
+					}
+					out[i] = gf_utils::cubic_hermite(
+						data[tap_frame(first, -1, lower_frame, upper_frame, max_frame) * stride],
+						data[tap_frame(first, 0, lower_frame, upper_frame, max_frame) * stride],
+						data[tap_frame(first, 1, lower_frame, upper_frame, max_frame) * stride],
+						data[tap_frame(first, 2, lower_frame, upper_frame, max_frame) * stride], tween);
+				}
+			}
+			else
+			{
+				using table = gf_sinc_table<T>;
+				const auto& sinc = table::get();
+				int inside_lower;
+				int inside_upper;
+				direct_range(table::offset, table::taps - 1 - table::offset, lower_frame, upper_frame, max_frame, guard,
+				             inside_lower, inside_upper);
+				T gathered[table::taps];
+				for (int i = 0; i < size; ++i)
+				{
+					const auto first = static_cast<int>(positions[i]);
+					T phase_fraction;
+					const int row = sinc_phase(static_cast<T>(positions[i] - first), phase_fraction) * table::taps;
+					const T* frames = gathered;
+					if (stride == 1 && first >= inside_lower && first <= inside_upper)
+					{
+						frames = data + first - table::offset;
+					}
+					else
+					{
+						for (int k = 0; k < table::taps; ++k)
+						{
+							gathered[k] = data[tap_frame(first, k - table::offset, lower_frame, upper_frame,
+							                             max_frame) * stride];
+						}
+					}
+					out[i] = sinc_dot(frames, &sinc.coefficients[row], &sinc.deltas[row], phase_fraction);
+				}
+			}
+		}
+
+		/// @brief interpolate with the mode chosen at runtime
+		template <typename T>
+		static void interpolate(const gf_interpolation mode, const T* data, const int stride, T* __restrict out,
+		                        const T* __restrict positions, const int size, const int lower_frame,
+		                        const int upper_frame, const int max_frame, const int guard = 0)
+		{
+			switch (mode)
+			{
+			case gf_interpolation::hermite:
+				interpolate<gf_interpolation::hermite>(data, stride, out, positions, size, lower_frame, upper_frame,
+				                                       max_frame, guard);
+				break;
+			case gf_interpolation::sinc:
+				interpolate<gf_interpolation::sinc>(data, stride, out, positions, size, lower_frame, upper_frame,
+				                                    max_frame, guard);
+				break;
+			default:
+				interpolate<gf_interpolation::linear>(data, stride, out, positions, size, lower_frame, upper_frame,
+				                                      max_frame, guard);
+				break;
+			}
+		}
+	};
+}
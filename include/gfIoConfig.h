@@ -1,6 +1,38 @@
 #pragma once
+#include <algorithm>
+
 namespace Grainflow
 {
+	enum class gf_bus_mode
+	{
+		stream = 0,
+		buffer_channel = 1,
+	};
+
+	/// @brief Outputs that only report grain state, see gf_io_config::report_mask()
+	enum gf_report_output : unsigned
+	{
+		gf_report_playhead = 1,
+		gf_report_stream_channel = 2,
+		gf_report_buffer_channel = 4,
+		gf_report_all = 7,
+	};
+
+	/// @brief What a grain did during one host block. Stream and buffer channel only change when a grain resets, so
+	/// hosts that read them here can leave the per sample grain_stream_channel and grain_buffer_channel rows nullptr.
+	struct gf_grain_meta
+	{
+		// One based like the grain_stream_channel and grain_buffer_channel rows
+		int stream = 0;
+		int buffer_channel = 0;
+		// Sample of the block where the grain last reset, -1 when it did not reset in this block
+		int reset_offset = -1;
+		// Normalized buffer position the current grain started from
+		float start_position = 0;
+		float rate = 1;
+		float amplitude = 0;
+	};
+
 	template<typename T = double>
 	struct gf_io_config
 	{
@@ -13,6 +45,8 @@ namespace Grainflow
 		T** grain_envelope = nullptr;
 		T** grain_buffer_channel = nullptr;
 		T** grain_stream_channel = nullptr;
+		// One entry per grain, written once per block when set
+		gf_grain_meta* grain_meta = nullptr;
 
 		//Inputs
 		T** grain_clock = nullptr;
@@ -25,8 +59,47 @@ namespace Grainflow
 		int fm_chans;
 		int am_chans;
 
+		// Set when every fm or am channel holds a single value for the whole block, such as a control rate input.
+		// Constant blocks are also detected when these are left unset.
+		bool fm_scalar = false;
+		bool am_scalar = false;
+
+		// Bus outputs. When set the collection overwrites each bus with the sum of grain_output of the grains routed
+		// to it, grains go to bus stream % bus_chans or buffer channel % bus_chans depending on bus_mode.
+		T** bus_output = nullptr;
+		int bus_chans = 0;
+		gf_bus_mode bus_mode = gf_bus_mode::stream;
+		// Per grain rows are only written when this is set, turn it off when the bus outputs are all that is needed.
+		// Single outputs can be turned off by leaving them nullptr, grain_output can be nullptr when a bus is set.
+		bool grain_rows = true;
+		// Rows grains write in place of the outputs that are not written, gf_grain::scratch_size samples for each
+		// grain processing at the same time. Collections point this at their own scratch, a host only sets it when
+		// it processes grains itself.
+		T* grain_scratch = nullptr;
+
 		bool livemode = false;
 		int block_size = 0;
 		int samplerate = 1;
+
+		/// @brief Whether grains write the rows of an output
+		[[nodiscard]] bool writes(T** rows) const
+		{
+			return grain_rows && rows != nullptr;
+		}
+
+		/// @brief The report outputs that have rows, grains skip computing the others
+		[[nodiscard]] unsigned report_mask() const
+		{
+			return (writes(grain_playhead) ? gf_report_playhead : 0u) |
+				(writes(grain_stream_channel) ? gf_report_stream_channel : 0u) |
+				(writes(grain_buffer_channel) ? gf_report_buffer_channel : 0u);
+		}
+
+		/// @brief The bus that a grain playing stream and buffer channel, both zero based, sums into
+		[[nodiscard]] int bus_index(const int stream, const int channel) const
+		{
+			const int route = bus_mode == gf_bus_mode::stream ? stream : channel;
+			return std::max(route, 0) % bus_chans;
+		}
 	};
 }
@@ -0,0 +1,99 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include "gfUtils.h"
+#include "gfSimd.h"
+
+namespace Grainflow
+{
+	/// <summary>
+	/// Vector kernels for the playhead of a grain. Each kernel has a scalar reference implementation that the vector
+	/// path is checked against. The double fold is exact against the reference while the float fold works in single
+	/// precision. The scan adds in a different order so it matches the reference to within rounding.
+	/// </summary>
+	class gf_kernels
+	{
+	public:
+		/// @brief Scalar reference for scan, out[i] = carry + in[0] + ... + in[i]
+		template <typename T>
+		static inline void scan_reference(T* __restrict out, const T* __restrict in, const T carry, const int size)
+		{
+			auto sum = carry;
+			for (int i = 0; i < size; ++i)
+			{
+				sum += in[i];
+				out[i] = sum;
+			}
+		}
+
+		/// @brief Inclusive prefix sum of in offset by carry, out[i] = carry + in[0] + ... + in[i]
+		template <typename T>
+		static inline void scan(T* __restrict out, const T* __restrict in, const T carry, const int size)
+		{
+			if constexpr (gf_simd<T>::enabled)
+			{
+				using simd = gf_simd<T>;
+				auto running = simd::set1(carry);
+				int i = 0;
+				for (; i + simd::width <= size; i += simd::width)
+				{
+					const auto sum = simd::add(simd::prefix_sum(simd::load(in + i)), running);
+					simd::store(out + i, sum);
+					running = simd::broadcast_last(sum);
+				}
+				scan_reference(out + i, in + i, i > 0 ? out[i - 1] : carry, size - i);
+			}
+			else
+			{
+				scan_reference(out, in, carry, size);
+			}
+		}
+
+		/// @brief Scalar reference for fold, gf_utils::pong applied to every position
+		template <typename T>
+		static inline void fold_reference(T* positions, const double start, const double end, const int fold,
+		                                  const int size)
+		{
+			for (int i = 0; i < size; ++i)
+			{
+				positions[i] = gf_utils::pong(positions[i], start, end, fold);
+			}
+		}
+
+		/// @brief Wraps (fold = 0) or ping pongs (fold = 1) positions into [start, end]. start and end must differ.
+		template <typename T>
+		static inline void fold(T* positions, const double start, const double end, const int fold, const int size)
+		{
+			const auto range = static_cast<T>(end - start);
+			const auto fold_offset = range * fold;
+			const auto fold_range = range * (fold + 1);
+			const auto fold_sign = static_cast<T>(1 - fold * 2);
+			const auto begin = static_cast<T>(start);
+			int i = 0;
+			if constexpr (gf_simd<T>::enabled)
+			{
+				using simd = gf_simd<T>;
+				const auto v_offset = simd::set1(fold_offset);
+				const auto v_range = simd::set1(fold_range);
+				const auto v_sign = simd::set1(fold_sign);
+				const auto v_begin = simd::set1(begin);
+				const auto zero = simd::set1(0);
+				for (; i + simd::width <= size; i += simd::width)
+				{
+					const auto a = simd::sub(simd::load(positions + i), v_begin);
+					auto wrapped = simd::sub(a, simd::mul(v_range, simd::floor(simd::div(a, v_range))));
+					wrapped = simd::max(zero, simd::min(wrapped, v_range));
+					const auto folded = simd::add(v_offset, simd::mul(v_sign, simd::abs(simd::sub(wrapped, v_offset))));
+					simd::store(positions + i, simd::add(folded, v_begin));
+				}
+			}
+			for (; i < size; ++i)
+			{
+				const auto a = positions[i] - begin;
+				auto wrapped = a - fold_range * gf_utils::fast_floor(a / fold_range);
+				wrapped = std::max<T>(0, std::min<T>(wrapped, fold_range));
+				positions[i] = fold_offset + fold_sign * std::abs(wrapped - fold_offset) + begin;
+			}
+		}
+	};
+}
@@ -1,6 +1,5 @@
 #pragma once
 #include <vector>
-#include <random>
 #include <algorithm>
 #include <atomic>
 #include <numeric>
@@ -28,9 +27,10 @@ namespace Grainflow
 		std::vector<sigtype> last_samples_ = {0};
 		std::vector<float> last_position_ = {0};
 		std::atomic<bool> latch_{false};
+		gf_rng rng_;
 
 
-		static void determine_pan_position(const int idx, const size_t block_size, const int channels,
+		static void determine_pan_position(gf_rng& rng, const int idx, const size_t block_size, const int channels,
 		                                   const float pan_center,
 		                                   const float pan_spread, const float quantization,
 		                                   std::vector<float>& last_positions, const int channel,
@@ -42,13 +42,13 @@ namespace Grainflow
 			switch (pan_mode)
 			{
 			case gf_pan_mode::bipolar:
-				position = gf_utils::deviate(pan_center, pan_spread);
+				position = gf_utils::deviate(rng, pan_center, pan_spread);
 				break;
 			case gf_pan_mode::unipolar:
-				position = gf_utils::random_range(pan_center, pan_center + pan_spread);
+				position = gf_utils::random_range(rng, pan_center, pan_center + pan_spread);
 				break;
 			case gf_pan_mode::stereo:
-				position = std::clamp(gf_utils::deviate(pan_center, pan_spread * 0.5f), 0.0f, 1.0f);
+				position = std::clamp(gf_utils::deviate(rng, pan_center, pan_spread * 0.5f), 0.0f, 1.0f);
 			}
 			const sigtype n_outputs = output_channels;
 			position = static_cast<float>(std::max<float>(
@@ -93,6 +93,12 @@ namespace Grainflow
 			set_channels(in_channels, out_channels);
 		}
 
+		/// @brief Seeds the generator used for pan positions, call before processing starts
+		void seed(const std::uint64_t seed)
+		{
+			rng_.seed(seed);
+		}
+
 		void set_channels(const int channels, const int output_channels = 2)
 		{
 			while (latch_.load()){
@@ -156,7 +162,7 @@ namespace Grainflow
 					auto idx = gf_utils::detect_one_transition<
 						sigtype>(states, InternalBlock, last_samples_.data(), ch);
 
-					determine_pan_position(idx, InternalBlock, channels_, position, spread, quantization,
+					determine_pan_position(rng_, idx, InternalBlock, channels_, position, spread, quantization,
 					                       last_position_, ch, output_chans, positions_);
 					perform_pan(input, positions_, InternalBlock, output_stream,
 					            this_block, output_chans);
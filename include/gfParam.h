@@ -1,7 +1,12 @@
 #pragma once
 #include <map>
+#include <array>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include "gfUtils.h"
 
 namespace Grainflow
@@ -111,112 +116,362 @@ namespace Grainflow
 		float value = 0;
 		gf_buffer_mode mode = gf_buffer_mode::normal;
 
-		void sample(int offset_id = 0, gf_random_mode random_mode = gf_random_mode::bipolar)
+		void sample(gf_rng& rng, int offset_id = 0, gf_random_mode random_mode = gf_random_mode::bipolar)
 		{
 			float random_value = 0.0f;
 			switch (random_mode)
 			{
 			case gf_random_mode::bipolar:
-				random_value = gf_utils::deviate(0, random);
+				random_value = gf_utils::deviate(rng, 0, random);
 				break;
 			case gf_random_mode::negative:
-				random_value = gf_utils::random_range(0, -random);
+				random_value = gf_utils::random_range(rng, 0, -random);
 				break;
 			case gf_random_mode::positive:
-				random_value = gf_utils::random_range(0, random);
+				random_value = gf_utils::random_range(rng, 0, random);
 				break;
 			}
 
 			value = base + offset * offset_id + random_value;
 		}
+
+		void sample(int offset_id = 0, gf_random_mode random_mode = gf_random_mode::bipolar)
+		{
+			sample(gf_rng::local(), offset_id, random_mode);
+		}
 	};
 
-	static bool buffer_reflection(std::string reflectionString, gf_buffers& type)
+	/// <summary>
+	/// Control side copy of a gf_param. Writers store the new field and mark it pending, the audio thread moves pending
+	/// fields into the live gf_param at the start of a block. Every field is atomic so neither side sees a torn value,
+	/// and repeated writes to a field between two blocks collapse into the latest one.
+	/// The value field is owned by the audio thread which publishes it back through current for readers.
+	/// </summary>
+	struct gf_param_shadow
 	{
-		if (reflectionString == "buf" || reflectionString == "buffer")
+		std::atomic<float> base{0};
+		std::atomic<float> random{0};
+		std::atomic<float> offset{0};
+		std::atomic<float> value{0};
+		std::atomic<int> mode{0};
+		std::atomic<float> current{0};
+		std::atomic<std::uint8_t> pending{0};
+
+		static_assert(std::atomic<float>::is_always_lock_free, "Atomic<float> must be lock free");
+
+		static constexpr std::uint8_t type_bit(const gf_param_type type)
 		{
-			type = gf_buffers::buffer;
+			return static_cast<std::uint8_t>(1u << static_cast<int>(type));
 		}
-		else if (reflectionString == "env" || reflectionString == "envelope")
+
+		/// @brief Matches the shadow to a live parameter and drops anything pending. Not safe while the audio thread
+		/// is running.
+		void reset(const gf_param& param)
 		{
-			type = gf_buffers::envelope;
+			base.store(param.base, std::memory_order_relaxed);
+			random.store(param.random, std::memory_order_relaxed);
+			offset.store(param.offset, std::memory_order_relaxed);
+			value.store(param.value, std::memory_order_relaxed);
+			mode.store(static_cast<int>(param.mode), std::memory_order_relaxed);
+			current.store(param.value, std::memory_order_relaxed);
+			pending.store(0, std::memory_order_release);
 		}
-		else if (reflectionString == "delay" || reflectionString == "delays" || reflectionString == "delayBuffer")
+
+		/// @brief Copies the shadow of another parameter including its pending fields
+		void copy(const gf_param_shadow& other)
 		{
-			type = gf_buffers::delay_buffer;
+			base.store(other.base.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			random.store(other.random.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			offset.store(other.offset.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			value.store(other.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			mode.store(other.mode.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			current.store(other.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			pending.store(other.pending.load(std::memory_order_acquire), std::memory_order_release);
 		}
-		else if (reflectionString == "window" || reflectionString == "windows" || reflectionString == "windowBuffer")
+
+		/// @brief Publishes a new field value, safe to call from any thread
+		void set(const gf_param_type type, const float new_value)
 		{
-			type = gf_buffers::window_buffer;
+			switch (type)
+			{
+			case gf_param_type::base:
+				base.store(new_value, std::memory_order_relaxed);
+				break;
+			case gf_param_type::random:
+				random.store(new_value, std::memory_order_relaxed);
+				break;
+			case gf_param_type::offset:
+				offset.store(new_value, std::memory_order_relaxed);
+				break;
+			case gf_param_type::mode:
+				mode.store(static_cast<int>(new_value), std::memory_order_relaxed);
+				break;
+			case gf_param_type::value:
+				value.store(new_value, std::memory_order_relaxed);
+				break;
+			default:
+				return;
+			}
+			pending.fetch_or(type_bit(type), std::memory_order_release);
 		}
-		else if (reflectionString == "glisson" || reflectionString == "glissonBuffer")
+
+		/// @brief Reads the latest published field, value reads return what the audio thread last used
+		[[nodiscard]] float get(const gf_param_type type) const
 		{
-			type = gf_buffers::glisson_buffer;
+			switch (type)
+			{
+			case gf_param_type::base:
+				return base.load(std::memory_order_relaxed);
+			case gf_param_type::random:
+				return random.load(std::memory_order_relaxed);
+			case gf_param_type::offset:
+				return offset.load(std::memory_order_relaxed);
+			case gf_param_type::mode:
+				return static_cast<float>(mode.load(std::memory_order_relaxed));
+			case gf_param_type::value:
+				return current.load(std::memory_order_relaxed);
+			default:
+				return 0;
+			}
 		}
-		else if (reflectionString == "rate" || reflectionString == "rates" || reflectionString == "rateBuffer")
+
+		/// @brief Moves pending fields into the live parameter, called from the audio thread
+		/// @return true if anything changed
+		bool apply(gf_param& param)
 		{
-			type = gf_buffers::rate_buffer;
+			if (pending.load(std::memory_order_relaxed) == 0) return false;
+			const auto fields = pending.exchange(0, std::memory_order_acquire);
+			if (fields & type_bit(gf_param_type::base)) param.base = base.load(std::memory_order_relaxed);
+			if (fields & type_bit(gf_param_type::random)) param.random = random.load(std::memory_order_relaxed);
+			if (fields & type_bit(gf_param_type::offset)) param.offset = offset.load(std::memory_order_relaxed);
+			if (fields & type_bit(gf_param_type::mode))
+				param.mode = static_cast<gf_buffer_mode>(mode.load(std::memory_order_relaxed));
+			if (fields & type_bit(gf_param_type::value)) param.value = value.load(std::memory_order_relaxed);
+			return fields != 0;
 		}
-		else
+	};
+
+	/// @brief Converts parameters that do not have their own param struct into the parameter they drive
+	/// @param param_name the parameter name, replaced with the parameter that should be set
+	/// @param param_type the field being set
+	/// @param value the value, replaced with the converted value
+	static void param_transform(gf_param_name& param_name, const gf_param_type& param_type, float& value)
+	{
+		if (param_type == gf_param_type::mode) return; //Modes are not a value type and should not be effected 
+		switch (param_name)
 		{
-			return false;
+		case gf_param_name::transpose:
+			if (param_type == gf_param_type::base) value = gf_utils::pitch_to_rate(value);
+			else value = gf_utils::pitch_offset_to_rate_offset(value);
+			param_name = gf_param_name::rate;
+			break;
+		case gf_param_name::glisson_st:
+			value = gf_utils::pitch_offset_to_rate_offset(value);
+			param_name = gf_param_name::glisson;
+			break;
+		case gf_param_name::amplitude:
+			if (param_type == gf_param_type::base) break;
+			value = std::max(std::min(-value, 0.0f), -1.0f);
+			break;
+		default:
+			break;
 		}
-		return true;
 	}
 
-
-	static bool param_reflection(std::string param, gf_param_name& out_param_name, gf_param_type& out_param_type)
+	/// <summary>
+	/// Compile time perfect hash from reflection strings to values. The seed is searched for when the map is built so
+	/// every key lands in its own slot and a lookup is one hash, one slot read and one string compare.
+	/// Lookups do not allocate and can be made from the audio thread.
+	/// </summary>
+	template <typename V, size_t N, size_t Slots = 64>
+	class gf_reflection_map
 	{
-		//Find and remove param types 
-		out_param_type = gf_param_type::ERR;
-		if (const auto pos = param.find("Random"); pos != std::string::npos)
+	public:
+		struct entry
+		{
+			std::string_view key;
+			V value;
+		};
+
+	private:
+		static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+		static_assert(N < Slots && N < 255, "Too many keys for the slot count");
+
+		std::array<entry, N> entries_;
+		std::array<std::uint8_t, Slots> slots_{};
+		std::uint32_t seed_ = 0;
+
+		static constexpr std::uint32_t hash(const std::string_view key, const std::uint32_t seed)
+		{
+			std::uint32_t h = 2166136261u ^ seed;
+			for (const char c : key)
+			{
+				h ^= static_cast<std::uint8_t>(c);
+				h *= 16777619u;
+			}
+			return h ^ (h >> 15);
+		}
+
+		constexpr bool try_seed(const std::uint32_t seed)
+		{
+			for (auto& slot : slots_) slot = 0;
+			for (size_t i = 0; i < N; ++i)
+			{
+				auto& slot = slots_[hash(entries_[i].key, seed) & (Slots - 1)];
+				if (slot != 0) return false;
+				slot = static_cast<std::uint8_t>(i + 1);
+			}
+			seed_ = seed;
+			return true;
+		}
+
+	public:
+		constexpr explicit gf_reflection_map(const std::array<entry, N>& entries) : entries_(entries)
 		{
-			out_param_type = gf_param_type::random;
-			param.erase(pos, 6);
+			for (std::uint32_t seed = 0; !try_seed(seed); ++seed)
+			{
+			}
+		}
+
+		/// @return the value for a key or nullptr if the key is unknown
+		[[nodiscard]] constexpr const V* find(const std::string_view key) const
+		{
+			const auto slot = slots_[hash(key, seed_) & (Slots - 1)];
+			if (slot == 0) return nullptr;
+			const auto& found = entries_[slot - 1];
+			return found.key == key ? &found.value : nullptr;
 		}
-		else if (const auto pos = param.find("Offset"); pos != std::string::npos)
+	};
+
+	inline constexpr gf_reflection_map<gf_buffers, 15> buffer_reflection_map{
 		{
-			out_param_type = gf_param_type::offset;
-			param.erase(pos, 6);
+			{
+				{"buf", gf_buffers::buffer},
+				{"buffer", gf_buffers::buffer},
+				{"env", gf_buffers::envelope},
+				{"envelope", gf_buffers::envelope},
+				{"delay", gf_buffers::delay_buffer},
+				{"delays", gf_buffers::delay_buffer},
+				{"delayBuffer", gf_buffers::delay_buffer},
+				{"window", gf_buffers::window_buffer},
+				{"windows", gf_buffers::window_buffer},
+				{"windowBuffer", gf_buffers::window_buffer},
+				{"glisson", gf_buffers::glisson_buffer},
+				{"glissonBuffer", gf_buffers::glisson_buffer},
+				{"rate", gf_buffers::rate_buffer},
+				{"rates", gf_buffers::rate_buffer},
+				{"rateBuffer", gf_buffers::rate_buffer},
+			}
 		}
-		else if (const auto pos = param.find("Mode"); pos != std::string::npos)
+	};
+
+	// The type stored with each name is base unless the parameter only has a value field
+	inline constexpr gf_reflection_map<std::pair<gf_param_name, gf_param_type>, 19> param_reflection_map{
 		{
-			out_param_type = gf_param_type::mode;
-			param.erase(pos, 4);
+			{
+				{"delay", {gf_param_name::delay, gf_param_type::base}},
+				{"rate", {gf_param_name::rate, gf_param_type::base}},
+				{"window", {gf_param_name::window, gf_param_type::base}},
+				{"amp", {gf_param_name::amplitude, gf_param_type::base}},
+				{"space", {gf_param_name::space, gf_param_type::base}},
+				{"envelopePosition", {gf_param_name::envelope_position, gf_param_type::base}},
+				{"direction", {gf_param_name::direction, gf_param_type::base}},
+				{"startPoint", {gf_param_name::start_point, gf_param_type::base}},
+				{"stopPoint", {gf_param_name::stop_point, gf_param_type::base}},
+				{"rateQuantizeSemi", {gf_param_name::rate_quantize_semi, gf_param_type::base}},
+				{"loopMode", {gf_param_name::loop_mode, gf_param_type::base}},
+				{"channel", {gf_param_name::channel, gf_param_type::base}},
+				{"density", {gf_param_name::density, gf_param_type::base}},
+				{"vibratoDepth", {gf_param_name::vibrato_depth, gf_param_type::base}},
+				{"vibratoRate", {gf_param_name::vibrato_rate, gf_param_type::base}},
+				//These cases are converted internally to other parameters
+				{"transpose", {gf_param_name::transpose, gf_param_type::base}},
+				{"glissonSt", {gf_param_name::glisson_st, gf_param_type::base}},
+				{"stream", {gf_param_name::stream, gf_param_type::base}},
+				{"nEnvelopes", {gf_param_name::n_envelopes, gf_param_type::value}},
+			}
 		}
-		else out_param_type = gf_param_type::base;
-		if (out_param_type == gf_param_type::ERR) return false;
+	};
+
+	static constexpr bool buffer_reflection(const std::string_view reflection_string, gf_buffers& type)
+	{
+		const auto found = buffer_reflection_map.find(reflection_string);
+		if (found == nullptr) return false;
+		type = *found;
+		return true;
+	}
 
+	static constexpr bool ends_with(const std::string_view text, const std::string_view suffix)
+	{
+		return text.size() > suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+	}
+
+	/// @brief Resolves names such as "space", "spaceRandom" or "delayOffset" into a parameter and field type
+	static constexpr bool param_reflection(const std::string_view param, gf_param_name& out_param_name,
+	                                       gf_param_type& out_param_type)
+	{
 		out_param_name = gf_param_name::ERR;
-		if (param == "delay") { out_param_name = gf_param_name::delay; }
-		else if (param == "rate") { out_param_name = gf_param_name::rate; }
-		else if (param == "window") { out_param_name = gf_param_name::window; }
-		else if (param == "rate") { out_param_name = gf_param_name::rate; }
-		else if (param == "amp") { out_param_name = gf_param_name::amplitude; }
-		else if (param == "space") { out_param_name = gf_param_name::space; }
-		else if (param == "envelopePosition") { out_param_name = gf_param_name::envelope_position; }
-		else if (param == "direction") { out_param_name = gf_param_name::direction; }
-		else if (param == "startPoint") { out_param_name = gf_param_name::start_point; }
-		else if (param == "stopPoint") { out_param_name = gf_param_name::stop_point; }
-		else if (param == "rateQuantizeSemi") { out_param_name = gf_param_name::rate_quantize_semi; }
-		else if (param == "loopMode") { out_param_name = gf_param_name::loop_mode; }
-		else if (param == "channel") { out_param_name = gf_param_name::channel; }
-		else if (param == "density") { out_param_name = gf_param_name::density; }
-		else if (param == "vibratoDepth") { out_param_name = gf_param_name::vibrato_depth; }
-		else if (param == "vibratoRate") { out_param_name = gf_param_name::vibrato_rate; }
-		//These cases are converted internally to other parameters 
-		else if (param == "transpose") { out_param_name = gf_param_name::transpose; }
-		else if (param == "glissonSt") { out_param_name = gf_param_name::glisson_st; }
-		else if (param == "stream") { out_param_name = gf_param_name::stream; }
-		else if (param == "nEnvelopes")
-		{
-			out_param_name = gf_param_name::n_envelopes;
-			out_param_type = gf_param_type::value;
-		}
-
-
-		if (out_param_name == gf_param_name::ERR) return false;
+		out_param_type = gf_param_type::ERR;
 
+		// Names are matched whole first so that names ending in a type such as loopMode resolve
+		auto found = param_reflection_map.find(param);
+		auto type = gf_param_type::base;
+		if (found == nullptr)
+		{
+			auto name = param;
+			if (ends_with(param, "Random"))
+			{
+				type = gf_param_type::random;
+				name.remove_suffix(6);
+			}
+			else if (ends_with(param, "Offset"))
+			{
+				type = gf_param_type::offset;
+				name.remove_suffix(6);
+			}
+			else if (ends_with(param, "Mode"))
+			{
+				type = gf_param_type::mode;
+				name.remove_suffix(4);
+			}
+			else return false;
+			found = param_reflection_map.find(name);
+			if (found == nullptr) return false;
+		}
+
+		out_param_name = found->first;
+		out_param_type = found->second == gf_param_type::value ? gf_param_type::value : type;
 		return true;
+	}
+
+	/// <summary>
+	/// A parameter and field resolved once from a reflection string so that repeated sets skip the string parsing
+	/// </summary>
+	struct gf_param_handle
+	{
+		gf_param_name name = gf_param_name::ERR;
+		gf_param_type type = gf_param_type::ERR;
+
+		[[nodiscard]] bool valid() const
+		{
+			return name != gf_param_name::ERR && type != gf_param_type::ERR;
+		}
 	};
+
+	/// @brief One entry of a batched parameter set, a target of 0 or less sets every grain
+	struct gf_param_update
+	{
+		gf_param_handle handle;
+		int target = 0;
+		float value = 0;
+	};
+
+	/// @brief Resolves a reflection string into a handle
+	/// @return the handle, invalid if the string does not name a parameter
+	static constexpr gf_param_handle param_handle(const std::string_view reflection_string)
+	{
+		gf_param_handle handle;
+		if (!param_reflection(reflection_string, handle.name, handle.type)) return {};
+		return handle;
+	}
 }
@@ -0,0 +1,219 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace Grainflow
+{
+	/// <summary>
+	/// A small xoshiro128+ generator. Each grain and panner owns one so random draws never touch shared state and
+	/// can run on any thread. The state is four words and a draw is a handful of integer operations.
+	/// Generators constructed without a seed get a distinct one from a global sequence, use seed() for repeatable
+	/// output.
+	/// </summary>
+	class gf_rng
+	{
+	private:
+		std::uint32_t s_[4] = {1, 0, 0, 0};
+
+		static constexpr std::uint32_t rotl(const std::uint32_t x, const int k)
+		{
+			return (x << k) | (x >> (32 - k));
+		}
+
+		friend class gf_rng_bank;
+
+	public:
+		gf_rng() : gf_rng(next_default_seed())
+		{
+		}
+
+		explicit gf_rng(const std::uint64_t seed)
+		{
+			this->seed(seed);
+		}
+
+		/// @brief Expands a 64 bit seed into the generator state with splitmix64
+		void seed(std::uint64_t seed)
+		{
+			for (int i = 0; i < 4; i += 2)
+			{
+				const auto z = splitmix64(seed);
+				s_[i] = static_cast<std::uint32_t>(z);
+				s_[i + 1] = static_cast<std::uint32_t>(z >> 32);
+			}
+			if ((s_[0] | s_[1] | s_[2] | s_[3]) == 0) s_[0] = 1;
+		}
+
+		inline std::uint32_t next()
+		{
+			const std::uint32_t result = s_[0] + s_[3];
+			const std::uint32_t t = s_[1] << 9;
+			s_[2] ^= s_[0];
+			s_[3] ^= s_[1];
+			s_[1] ^= s_[2];
+			s_[0] ^= s_[3];
+			s_[2] ^= t;
+			s_[3] = rotl(s_[3], 11);
+			return result;
+		}
+
+		/// @return a value in [0, 1) built from the upper 24 bits, the low bits of xoshiro128+ are weaker
+		inline float uniform()
+		{
+			return static_cast<float>(next() >> 8) * 0x1.0p-24f;
+		}
+
+		/// @return a value in [lower, upper)
+		inline float uniform(const float lower, const float upper)
+		{
+			return lower + (upper - lower) * uniform();
+		}
+
+		/// @return an integer in [0, n) without a division
+		inline std::uint32_t below(const std::uint32_t n)
+		{
+			return static_cast<std::uint32_t>((static_cast<std::uint64_t>(next()) * n) >> 32);
+		}
+
+		/// @brief Fills an array with values in [0, 1)
+		void fill(float* __restrict out, const int size)
+		{
+			for (int i = 0; i < size; ++i)
+			{
+				out[i] = uniform();
+			}
+		}
+
+		static std::uint64_t splitmix64(std::uint64_t& x)
+		{
+			std::uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		/// @brief Derives the seed of one generator in a family, such as grain g of a collection
+		static std::uint64_t derive_seed(std::uint64_t seed, const std::uint64_t index)
+		{
+			seed ^= index * 0xD1B54A32D192ED03ull;
+			return splitmix64(seed);
+		}
+
+		/// @brief Seeds for generators created without one, unique per process
+		static std::uint64_t next_default_seed()
+		{
+			static std::atomic<std::uint64_t> counter{0x853C49E6748FEA9Bull};
+			auto seed = counter.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed);
+			return splitmix64(seed);
+		}
+
+		/// @brief A generator owned by the calling thread for control side helpers that have no generator of their own
+		static gf_rng& local()
+		{
+			thread_local gf_rng rng;
+			return rng;
+		}
+	};
+
+	/// <summary>
+	/// A bank of gf_rng generators stored as a structure of arrays, one generator per lane.
+	/// Drawing for a range of lanes updates every lane with the same operations so the loop runs in vector registers.
+	/// A single lane can be loaded into a gf_rng, used, and stored back.
+	/// </summary>
+	class gf_rng_bank
+	{
+	private:
+		std::vector<std::uint32_t> s0_;
+		std::vector<std::uint32_t> s1_;
+		std::vector<std::uint32_t> s2_;
+		std::vector<std::uint32_t> s3_;
+
+	public:
+		void resize(const int lanes)
+		{
+			s0_.assign(lanes, 1);
+			s1_.assign(lanes, 0);
+			s2_.assign(lanes, 0);
+			s3_.assign(lanes, 0);
+		}
+
+		[[nodiscard]] int size() const
+		{
+			return static_cast<int>(s0_.size());
+		}
+
+		/// @brief Seeds every lane with a generator derived from seed and the lane index
+		void seed(const std::uint64_t seed)
+		{
+			for (int l = 0; l < size(); ++l)
+			{
+				store(l, gf_rng(gf_rng::derive_seed(seed, l)));
+			}
+		}
+
+		[[nodiscard]] gf_rng load(const int lane) const
+		{
+			gf_rng rng(0);
+			rng.s_[0] = s0_[lane];
+			rng.s_[1] = s1_[lane];
+			rng.s_[2] = s2_[lane];
+			rng.s_[3] = s3_[lane];
+			return rng;
+		}
+
+		void store(const int lane, const gf_rng& rng)
+		{
+			s0_[lane] = rng.s_[0];
+			s1_[lane] = rng.s_[1];
+			s2_[lane] = rng.s_[2];
+			s3_[lane] = rng.s_[3];
+		}
+
+		/// @brief Draws one value in [0, 1) for each lane in [first, first + count)
+		void uniform(float* __restrict out, const int first, const int count)
+		{
+			std::uint32_t* __restrict s0 = s0_.data() + first;
+			std::uint32_t* __restrict s1 = s1_.data() + first;
+			std::uint32_t* __restrict s2 = s2_.data() + first;
+			std::uint32_t* __restrict s3 = s3_.data() + first;
+			for (int l = 0; l < count; ++l)
+			{
+				const std::uint32_t result = s0[l] + s3[l];
+				const std::uint32_t t = s1[l] << 9;
+				s2[l] ^= s0[l];
+				s3[l] ^= s1[l];
+				s1[l] ^= s2[l];
+				s0[l] ^= s3[l];
+				s2[l] ^= t;
+				s3[l] = gf_rng::rotl(s3[l], 11);
+				out[l] = static_cast<float>(result >> 8) * 0x1.0p-24f;
+			}
+		}
+
+		/// @brief Draws one value in [0, 1) for each lane in [first, first + count), only lanes with a non zero
+		/// mask advance. Lanes that are masked out still write a value to out.
+		void uniform(float* __restrict out, const int first, const int count, const std::uint8_t* __restrict mask)
+		{
+			std::uint32_t* __restrict s0 = s0_.data() + first;
+			std::uint32_t* __restrict s1 = s1_.data() + first;
+			std::uint32_t* __restrict s2 = s2_.data() + first;
+			std::uint32_t* __restrict s3 = s3_.data() + first;
+			for (int l = 0; l < count; ++l)
+			{
+				const std::uint32_t keep = mask[l] ? 0u : ~0u;
+				const std::uint32_t result = s0[l] + s3[l];
+				const std::uint32_t t = s1[l] << 9;
+				const std::uint32_t n2 = s2[l] ^ s0[l];
+				const std::uint32_t n3 = s3[l] ^ s1[l];
+				const std::uint32_t n1 = s1[l] ^ n2;
+				const std::uint32_t n0 = s0[l] ^ n3;
+				s0[l] = (s0[l] & keep) | (n0 & ~keep);
+				s1[l] = (s1[l] & keep) | (n1 & ~keep);
+				s2[l] = (s2[l] & keep) | ((n2 ^ t) & ~keep);
+				s3[l] = (s3[l] & keep) | (gf_rng::rotl(n3, 11) & ~keep);
+				out[l] = static_cast<float>(result >> 8) * 0x1.0p-24f;
+			}
+		}
+	};
+}
@@ -0,0 +1,315 @@
+#pragma once
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GF_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#if defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#endif
+#define GF_SIMD_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GF_SIMD_NEON 1
+#endif
+
+namespace Grainflow
+{
+	/// <summary>
+	/// Thin wrappers over the vector registers of the target so kernels can be written once.
+	/// min and max follow std::min and std::max argument order. Comparisons return a lane mask of all ones or all
+	/// zeros, mask() packs the top bit of each lane into an int with lane 0 in bit 0.
+	/// </summary>
+	template <typename T>
+	struct gf_simd
+	{
+		static constexpr bool enabled = false;
+		static constexpr int width = 1;
+	};
+
+#if defined(GF_SIMD_AVX2)
+	template <>
+	struct gf_simd<double>
+	{
+		using reg = __m256d;
+		static constexpr bool enabled = true;
+		static constexpr int width = 4;
+
+		static inline reg load(const double* p) { return _mm256_loadu_pd(p); }
+		static inline void store(double* p, const reg a) { _mm256_storeu_pd(p, a); }
+		static inline reg set1(const double a) { return _mm256_set1_pd(a); }
+		static inline reg add(const reg a, const reg b) { return _mm256_add_pd(a, b); }
+		static inline reg sub(const reg a, const reg b) { return _mm256_sub_pd(a, b); }
+		static inline reg mul(const reg a, const reg b) { return _mm256_mul_pd(a, b); }
+		static inline reg div(const reg a, const reg b) { return _mm256_div_pd(a, b); }
+		static inline reg min(const reg a, const reg b) { return _mm256_min_pd(b, a); }
+		static inline reg max(const reg a, const reg b) { return _mm256_max_pd(b, a); }
+		static inline reg abs(const reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+		static inline reg floor(const reg a) { return _mm256_floor_pd(a); }
+
+		/// @brief Inclusive prefix sum across the register
+		static inline reg prefix_sum(reg a)
+		{
+			a = _mm256_add_pd(a, _mm256_blend_pd(_mm256_permute4x64_pd(a, _MM_SHUFFLE(2, 1, 0, 0)),
+			                                     _mm256_setzero_pd(), 0x1));
+			return _mm256_add_pd(a, _mm256_permute2f128_pd(a, a, 0x08));
+		}
+
+		static inline reg cmp_lt(const reg a, const reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+		static inline reg cmp_le(const reg a, const reg b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+		static inline reg cmp_gt(const reg a, const reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+		static inline reg cmp_ge(const reg a, const reg b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+		static inline reg bit_and(const reg a, const reg b) { return _mm256_and_pd(a, b); }
+		static inline reg bit_or(const reg a, const reg b) { return _mm256_or_pd(a, b); }
+		static inline reg bit_andnot(const reg a, const reg b) { return _mm256_andnot_pd(a, b); }
+		static inline int mask(const reg a) { return _mm256_movemask_pd(a); }
+
+		static inline reg broadcast_last(const reg a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 3, 3, 3)); }
+	};
+
+	template <>
+	struct gf_simd<float>
+	{
+		using reg = __m256;
+		static constexpr bool enabled = true;
+		static constexpr int width = 8;
+
+		static inline reg load(const float* p) { return _mm256_loadu_ps(p); }
+		static inline void store(float* p, const reg a) { _mm256_storeu_ps(p, a); }
+		static inline reg set1(const float a) { return _mm256_set1_ps(a); }
+		static inline reg add(const reg a, const reg b) { return _mm256_add_ps(a, b); }
+		static inline reg sub(const reg a, const reg b) { return _mm256_sub_ps(a, b); }
+		static inline reg mul(const reg a, const reg b) { return _mm256_mul_ps(a, b); }
+		static inline reg div(const reg a, const reg b) { return _mm256_div_ps(a, b); }
+		static inline reg min(const reg a, const reg b) { return _mm256_min_ps(b, a); }
+		static inline reg max(const reg a, const reg b) { return _mm256_max_ps(b, a); }
+		static inline reg abs(const reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static inline reg floor(const reg a) { return _mm256_floor_ps(a); }
+
+		static inline reg prefix_sum(reg a)
+		{
+			a = _mm256_add_ps(a, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(a), 4)));
+			a = _mm256_add_ps(a, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(a), 8)));
+			// Carry the total of the low half into the high half
+			const auto low = _mm256_permute2f128_ps(a, a, 0x08);
+			return _mm256_add_ps(a, _mm256_shuffle_ps(low, low, _MM_SHUFFLE(3, 3, 3, 3)));
+		}
+
+		static inline reg cmp_lt(const reg a, const reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static inline reg cmp_le(const reg a, const reg b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static inline reg cmp_gt(const reg a, const reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static inline reg cmp_ge(const reg a, const reg b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static inline reg bit_and(const reg a, const reg b) { return _mm256_and_ps(a, b); }
+		static inline reg bit_or(const reg a, const reg b) { return _mm256_or_ps(a, b); }
+		static inline reg bit_andnot(const reg a, const reg b) { return _mm256_andnot_ps(a, b); }
+		static inline int mask(const reg a) { return _mm256_movemask_ps(a); }
+
+		static inline reg broadcast_last(const reg a)
+		{
+			const auto high = _mm256_permute2f128_ps(a, a, 0x11);
+			return _mm256_shuffle_ps(high, high, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+	};
+#elif defined(GF_SIMD_SSE2)
+	template <>
+	struct gf_simd<double>
+	{
+		using reg = __m128d;
+		static constexpr bool enabled = true;
+		static constexpr int width = 2;
+
+		static inline reg load(const double* p) { return _mm_loadu_pd(p); }
+		static inline void store(double* p, const reg a) { _mm_storeu_pd(p, a); }
+		static inline reg set1(const double a) { return _mm_set1_pd(a); }
+		static inline reg add(const reg a, const reg b) { return _mm_add_pd(a, b); }
+		static inline reg sub(const reg a, const reg b) { return _mm_sub_pd(a, b); }
+		static inline reg mul(const reg a, const reg b) { return _mm_mul_pd(a, b); }
+		static inline reg div(const reg a, const reg b) { return _mm_div_pd(a, b); }
+		static inline reg min(const reg a, const reg b) { return _mm_min_pd(b, a); }
+		static inline reg max(const reg a, const reg b) { return _mm_max_pd(b, a); }
+		static inline reg abs(const reg a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+
+		static inline reg floor(const reg a)
+		{
+#if defined(__SSE4_1__) || defined(__AVX__)
+			return _mm_floor_pd(a);
+#else
+			// Round through the 2^52 magic number and step down where rounding went up
+			const auto magic = _mm_or_pd(_mm_set1_pd(4503599627370496.0), _mm_and_pd(a, _mm_set1_pd(-0.0)));
+			auto rounded = _mm_sub_pd(_mm_add_pd(a, magic), magic);
+			rounded = _mm_sub_pd(rounded, _mm_and_pd(_mm_cmpgt_pd(rounded, a), _mm_set1_pd(1.0)));
+			const auto integral = _mm_cmpge_pd(abs(a), _mm_set1_pd(4503599627370496.0));
+			return _mm_or_pd(_mm_and_pd(integral, a), _mm_andnot_pd(integral, rounded));
+#endif
+		}
+
+		static inline reg prefix_sum(const reg a)
+		{
+			return _mm_add_pd(a, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(a), 8)));
+		}
+
+		static inline reg cmp_lt(const reg a, const reg b) { return _mm_cmplt_pd(a, b); }
+		static inline reg cmp_le(const reg a, const reg b) { return _mm_cmple_pd(a, b); }
+		static inline reg cmp_gt(const reg a, const reg b) { return _mm_cmpgt_pd(a, b); }
+		static inline reg cmp_ge(const reg a, const reg b) { return _mm_cmpge_pd(a, b); }
+		static inline reg bit_and(const reg a, const reg b) { return _mm_and_pd(a, b); }
+		static inline reg bit_or(const reg a, const reg b) { return _mm_or_pd(a, b); }
+		static inline reg bit_andnot(const reg a, const reg b) { return _mm_andnot_pd(a, b); }
+		static inline int mask(const reg a) { return _mm_movemask_pd(a); }
+
+		static inline reg broadcast_last(const reg a) { return _mm_unpackhi_pd(a, a); }
+	};
+
+	template <>
+	struct gf_simd<float>
+	{
+		using reg = __m128;
+		static constexpr bool enabled = true;
+		static constexpr int width = 4;
+
+		static inline reg load(const float* p) { return _mm_loadu_ps(p); }
+		static inline void store(float* p, const reg a) { _mm_storeu_ps(p, a); }
+		static inline reg set1(const float a) { return _mm_set1_ps(a); }
+		static inline reg add(const reg a, const reg b) { return _mm_add_ps(a, b); }
+		static inline reg sub(const reg a, const reg b) { return _mm_sub_ps(a, b); }
+		static inline reg mul(const reg a, const reg b) { return _mm_mul_ps(a, b); }
+		static inline reg div(const reg a, const reg b) { return _mm_div_ps(a, b); }
+		static inline reg min(const reg a, const reg b) { return _mm_min_ps(b, a); }
+		static inline reg max(const reg a, const reg b) { return _mm_max_ps(b, a); }
+		static inline reg abs(const reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+		static inline reg floor(const reg a)
+		{
+#if defined(__SSE4_1__) || defined(__AVX__)
+			return _mm_floor_ps(a);
+#else
+			const auto magic = _mm_or_ps(_mm_set1_ps(8388608.0f), _mm_and_ps(a, _mm_set1_ps(-0.0f)));
+			auto rounded = _mm_sub_ps(_mm_add_ps(a, magic), magic);
+			rounded = _mm_sub_ps(rounded, _mm_and_ps(_mm_cmpgt_ps(rounded, a), _mm_set1_ps(1.0f)));
+			const auto integral = _mm_cmpge_ps(abs(a), _mm_set1_ps(8388608.0f));
+			return _mm_or_ps(_mm_and_ps(integral, a), _mm_andnot_ps(integral, rounded));
+#endif
+		}
+
+		static inline reg prefix_sum(reg a)
+		{
+			a = _mm_add_ps(a, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a), 4)));
+			return _mm_add_ps(a, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a), 8)));
+		}
+
+		static inline reg cmp_lt(const reg a, const reg b) { return _mm_cmplt_ps(a, b); }
+		static inline reg cmp_le(const reg a, const reg b) { return _mm_cmple_ps(a, b); }
+		static inline reg cmp_gt(const reg a, const reg b) { return _mm_cmpgt_ps(a, b); }
+		static inline reg cmp_ge(const reg a, const reg b) { return _mm_cmpge_ps(a, b); }
+		static inline reg bit_and(const reg a, const reg b) { return _mm_and_ps(a, b); }
+		static inline reg bit_or(const reg a, const reg b) { return _mm_or_ps(a, b); }
+		static inline reg bit_andnot(const reg a, const reg b) { return _mm_andnot_ps(a, b); }
+		static inline int mask(const reg a) { return _mm_movemask_ps(a); }
+
+		static inline reg broadcast_last(const reg a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)); }
+	};
+#elif defined(GF_SIMD_NEON)
+	template <>
+	struct gf_simd<double>
+	{
+		using reg = float64x2_t;
+		static constexpr bool enabled = true;
+		static constexpr int width = 2;
+
+		static inline reg load(const double* p) { return vld1q_f64(p); }
+		static inline void store(double* p, const reg a) { vst1q_f64(p, a); }
+		static inline reg set1(const double a) { return vdupq_n_f64(a); }
+		static inline reg add(const reg a, const reg b) { return vaddq_f64(a, b); }
+		static inline reg sub(const reg a, const reg b) { return vsubq_f64(a, b); }
+		static inline reg mul(const reg a, const reg b) { return vmulq_f64(a, b); }
+		static inline reg div(const reg a, const reg b) { return vdivq_f64(a, b); }
+		static inline reg min(const reg a, const reg b) { return vbslq_f64(vcltq_f64(b, a), b, a); }
+		static inline reg max(const reg a, const reg b) { return vbslq_f64(vcltq_f64(a, b), b, a); }
+		static inline reg abs(const reg a) { return vabsq_f64(a); }
+		static inline reg floor(const reg a) { return vrndmq_f64(a); }
+		static inline reg prefix_sum(const reg a) { return vaddq_f64(a, vextq_f64(vdupq_n_f64(0.0), a, 1)); }
+		static inline reg cmp_lt(const reg a, const reg b) { return vreinterpretq_f64_u64(vcltq_f64(a, b)); }
+		static inline reg cmp_le(const reg a, const reg b) { return vreinterpretq_f64_u64(vcleq_f64(a, b)); }
+		static inline reg cmp_gt(const reg a, const reg b) { return vreinterpretq_f64_u64(vcgtq_f64(a, b)); }
+		static inline reg cmp_ge(const reg a, const reg b) { return vreinterpretq_f64_u64(vcgeq_f64(a, b)); }
+
+		static inline reg bit_and(const reg a, const reg b)
+		{
+			return vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(a), vreinterpretq_u64_f64(b)));
+		}
+
+		static inline reg bit_or(const reg a, const reg b)
+		{
+			return vreinterpretq_f64_u64(vorrq_u64(vreinterpretq_u64_f64(a), vreinterpretq_u64_f64(b)));
+		}
+
+		static inline reg bit_andnot(const reg a, const reg b)
+		{
+			return vreinterpretq_f64_u64(vbicq_u64(vreinterpretq_u64_f64(b), vreinterpretq_u64_f64(a)));
+		}
+
+		static inline int mask(const reg a)
+		{
+			const auto bits = vshrq_n_u64(vreinterpretq_u64_f64(a), 63);
+			return static_cast<int>(vgetq_lane_u64(bits, 0) | (vgetq_lane_u64(bits, 1) << 1));
+		}
+
+		static inline reg broadcast_last(const reg a) { return vdupq_laneq_f64(a, 1); }
+	};
+
+	template <>
+	struct gf_simd<float>
+	{
+		using reg = float32x4_t;
+		static constexpr bool enabled = true;
+		static constexpr int width = 4;
+
+		static inline reg load(const float* p) { return vld1q_f32(p); }
+		static inline void store(float* p, const reg a) { vst1q_f32(p, a); }
+		static inline reg set1(const float a) { return vdupq_n_f32(a); }
+		static inline reg add(const reg a, const reg b) { return vaddq_f32(a, b); }
+		static inline reg sub(const reg a, const reg b) { return vsubq_f32(a, b); }
+		static inline reg mul(const reg a, const reg b) { return vmulq_f32(a, b); }
+		static inline reg div(const reg a, const reg b) { return vdivq_f32(a, b); }
+		static inline reg min(const reg a, const reg b) { return vbslq_f32(vcltq_f32(b, a), b, a); }
+		static inline reg max(const reg a, const reg b) { return vbslq_f32(vcltq_f32(a, b), b, a); }
+		static inline reg abs(const reg a) { return vabsq_f32(a); }
+		static inline reg floor(const reg a) { return vrndmq_f32(a); }
+
+		static inline reg prefix_sum(reg a)
+		{
+			a = vaddq_f32(a, vextq_f32(vdupq_n_f32(0.0f), a, 3));
+			return vaddq_f32(a, vextq_f32(vdupq_n_f32(0.0f), a, 2));
+		}
+
+		static inline reg cmp_lt(const reg a, const reg b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+		static inline reg cmp_le(const reg a, const reg b) { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+		static inline reg cmp_gt(const reg a, const reg b) { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+		static inline reg cmp_ge(const reg a, const reg b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+
+		static inline reg bit_and(const reg a, const reg b)
+		{
+			return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+		}
+
+		static inline reg bit_or(const reg a, const reg b)
+		{
+			return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+		}
+
+		static inline reg bit_andnot(const reg a, const reg b)
+		{
+			return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(b), vreinterpretq_u32_f32(a)));
+		}
+
+		static inline int mask(const reg a)
+		{
+			static const int32_t shifts[4] = {0, 1, 2, 3};
+			const auto bits = vshlq_u32(vshrq_n_u32(vreinterpretq_u32_f32(a), 31), vld1q_s32(shifts));
+			return static_cast<int>(vaddvq_u32(bits));
+		}
+
+		static inline reg broadcast_last(const reg a) { return vdupq_laneq_f32(a, 3); }
+	};
+#endif
+}
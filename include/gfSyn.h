@@ -2,6 +2,9 @@
 #include "gfUtils.h"
 #include "gfEnvelopes.h"
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 #ifndef M_PI
 	#define _USE_MATH_DEFINES
 	#include <cmath>
@@ -240,6 +243,16 @@ namespace Grainflow
 			rate_ = rate * file_samplerate / (file_samples * samplerate);
 		}
 
+		inline void reset(T phase = 0)
+		{
+			history_ = phase;
+		}
+
+		[[nodiscard]] inline T phase() const
+		{
+			return history_;
+		}
+
 		void perform(T* buffer, const int frames = INTERNALBLOCK)
 		{
 			const int tiles = frames/INTERNALBLOCK;
@@ -247,6 +260,122 @@ namespace Grainflow
 				auto *pin = buffer+(i*INTERNALBLOCK);
 				GfSyn::PhasorWave<T, INTERNALBLOCK>(pin, rate_, history_);
 			}
+			// A partial tile is left when frames is not a multiple of INTERNALBLOCK
+			const int remainder = frames - tiles * INTERNALBLOCK;
+			if (remainder <= 0) return;
+			auto* pin = buffer + (tiles * INTERNALBLOCK);
+			for (int j = 0; j < remainder; ++j)
+			{
+				pin[j] = gf_utils::mod<T>(history_ + rate_ * j);
+			}
+			history_ = gf_utils::mod<T>(history_ + rate_ * remainder);
+		}
+	};
+
+	/// <summary>
+	/// A bank of phasors that fills one row per channel every block.
+	/// Rates in Hz and phases can be set from any thread and take effect at the start of the next block.
+	/// There are always at least two rows so readers that compare the first two row pointers see distinct rows.
+	/// </summary>
+	template <typename T, long INTERNALBLOCK>
+	class phasor_bank
+	{
+		template <typename, long>
+		friend class phasor_bank;
+
+	private:
+		std::vector<phasor<T, INTERNALBLOCK>> phasors_;
+		std::unique_ptr<std::atomic<float>[]> rates_;
+		// A negative phase means no phase change is pending
+		std::unique_ptr<std::atomic<float>[]> phases_;
+		std::vector<T> storage_;
+		std::vector<T*> rows_;
+		int channels_ = 0;
+		int capacity_ = 0;
+
+	public:
+		/// @brief Sets the number of channels, zero turns the bank off. Allocates and replaces the rows perform()
+		/// returns, so it must not run while another thread is inside perform() or reading its rows.
+		void resize(const int channels, const float rate = 0, const int max_block_size = 512)
+		{
+			channels_ = std::max(channels, 0);
+			phasors_.assign(channels_, phasor<T, INTERNALBLOCK>(0, 1));
+			rates_ = std::make_unique<std::atomic<float>[]>(channels_);
+			phases_ = std::make_unique<std::atomic<float>[]>(channels_);
+			for (int ch = 0; ch < channels_; ++ch)
+			{
+				rates_[ch].store(rate);
+				phases_[ch].store(-1);
+			}
+			prepare(max_block_size);
+		}
+
+		/// @brief Allocates rows for blocks of up to max_block_size samples
+		void prepare(const int max_block_size)
+		{
+			capacity_ = std::max(max_block_size, 1);
+			const int rows = channels_ > 0 ? std::max(channels_, 2) : 0;
+			storage_.assign(static_cast<size_t>(rows) * capacity_, 0);
+			rows_.resize(rows);
+			for (int r = 0; r < rows; ++r)
+			{
+				rows_[r] = &storage_[static_cast<size_t>(r) * capacity_];
+			}
+		}
+
+		/// @brief Copies channels, rates and phases from another bank
+		template <long OTHERBLOCK>
+		void copy(const phasor_bank<T, OTHERBLOCK>& other)
+		{
+			resize(other.channels_, 0, other.capacity_);
+			for (int ch = 0; ch < channels_; ++ch)
+			{
+				rates_[ch].store(other.rates_[ch].load());
+				phases_[ch].store(other.phases_[ch].load());
+				phasors_[ch].reset(other.phasors_[ch].phase());
+			}
+		}
+
+		[[nodiscard]] int channels() const
+		{
+			return channels_;
+		}
+
+		/// @param channel a zero based channel, or a negative channel for all of them
+		void set_rate(const int channel, const float rate)
+		{
+			for (int ch = 0; ch < channels_; ++ch)
+			{
+				if (channel < 0 || channel == ch) rates_[ch].store(rate, std::memory_order_relaxed);
+			}
+		}
+
+		/// @param channel a zero based channel, or a negative channel for all of them
+		void set_phase(const int channel, const float phase)
+		{
+			for (int ch = 0; ch < channels_; ++ch)
+			{
+				if (channel < 0 || channel == ch)
+					phases_[ch].store(gf_utils::mod<float>(phase), std::memory_order_relaxed);
+			}
+		}
+
+		/// @brief Advances every channel by frames samples. Allocates when frames exceeds the max_block_size given to
+		/// resize() or prepare(), so size those for the largest host block.
+		/// @return one row per channel
+		T** perform(const int frames, const int samplerate)
+		{
+			if (frames > capacity_) prepare(frames);
+			for (int ch = 0; ch < channels_; ++ch)
+			{
+				if (const auto phase = phases_[ch].exchange(-1, std::memory_order_relaxed); phase >= 0)
+				{
+					phasors_[ch].reset(phase);
+				}
+				phasors_[ch].set_rate(rates_[ch].load(std::memory_order_relaxed), samplerate);
+				phasors_[ch].perform(rows_[ch], frames);
+			}
+			return rows_.data();
 		}
 	};
 }
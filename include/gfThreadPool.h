@@ -0,0 +1,202 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+
+namespace Grainflow
+{
+	/// <summary>
+	/// A pool of pre-spawned workers used to split grain processing across cores.
+	/// Work is submitted as a range of items that is cut into fixed size chunks. Every worker owns a contiguous
+	/// slice of the chunks and steals chunks from the other slices once its own slice is empty.
+	/// Submitting work does not allocate or lock, so run() can be called from the audio thread. Workers spin between
+	/// calls and only go to sleep on a condition variable after spin_count idle checks, run() signals it only when a
+	/// worker is asleep, which can cost a system call.
+	/// The calling thread takes part in the work and run() returns once every chunk has been processed.
+	/// </summary>
+	class gf_thread_pool
+	{
+	public:
+		using task_func = void (*)(void* context, int begin, int end);
+
+	private:
+		// Each range packs [generation:16][next chunk:24][end chunk:24] so that a worker waking up late can never
+		// claim a chunk that belongs to a later call to run()
+		struct alignas(64) chunk_range
+		{
+			std::atomic<std::uint64_t> state{0};
+		};
+
+		static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Atomic<uint64_t> must be lock free");
+		static constexpr std::uint64_t field_mask = (1ull << 24) - 1;
+		static constexpr int next_shift = 24;
+		static constexpr int generation_shift = 48;
+
+		std::vector<std::thread> threads_;
+		std::unique_ptr<chunk_range[]> ranges_;
+		int n_slots_ = 1;
+
+		std::atomic<unsigned int> generation_{0};
+		std::atomic<int> remaining_chunks_{0};
+		std::atomic<bool> stop_{false};
+		std::mutex wake_mutex_;
+		std::condition_variable wake_;
+		// Workers waiting on wake_, run() skips the notify while this is zero
+		std::atomic<int> sleepers_{0};
+
+		task_func task_ = nullptr;
+		void* context_ = nullptr;
+		int n_items_ = 0;
+		int chunk_size_ = 1;
+
+		static constexpr int spin_count = 2048;
+
+		static inline std::uint64_t pack(const unsigned int generation, const int next, const int end)
+		{
+			return (static_cast<std::uint64_t>(generation & 0xffff) << generation_shift) |
+				(static_cast<std::uint64_t>(next) << next_shift) | static_cast<std::uint64_t>(end);
+		}
+
+		/// @brief Claims the next chunk of a range if it belongs to the given generation
+		/// @return the claimed chunk or -1 if the range is empty
+		static inline int claim(chunk_range& range, const unsigned int generation)
+		{
+			auto state = range.state.load(std::memory_order_acquire);
+			while (true)
+			{
+				const auto next = static_cast<int>((state >> next_shift) & field_mask);
+				const auto end = static_cast<int>(state & field_mask);
+				if ((state >> generation_shift) != (generation & 0xffff) || next >= end) return -1;
+				if (range.state.compare_exchange_weak(state, state + (1ull << next_shift), std::memory_order_acquire,
+				                                      std::memory_order_acquire))
+					return next;
+			}
+		}
+
+		/// @brief Processes the chunks owned by a slot and then steals from the remaining slots
+		/// @param slot the slot owned by the calling worker, 0 is the thread that called run()
+		/// @param generation the call to run() the worker is helping with
+		void work(const int slot, const unsigned int generation)
+		{
+			for (int offset = 0; offset < n_slots_; ++offset)
+			{
+				auto& range = ranges_[(slot + offset) % n_slots_];
+				for (int chunk = claim(range, generation); chunk >= 0; chunk = claim(range, generation))
+				{
+					const int begin = chunk * chunk_size_;
+					const int end = std::min(begin + chunk_size_, n_items_);
+					task_(context_, begin, end);
+					remaining_chunks_.fetch_sub(1, std::memory_order_release);
+				}
+			}
+		}
+
+		void worker_loop(const int slot)
+		{
+			unsigned int seen_generation = 0;
+			while (true)
+			{
+				int spins = 0;
+				while (generation_.load(std::memory_order_acquire) == seen_generation && !stop_.load())
+				{
+					if (++spins < spin_count)
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					// Registering before the last check means run() either sees the sleeper or the worker sees the new
+					// generation, a notify that still slips in before the wait is covered by the timeout
+					std::unique_lock<std::mutex> lock(wake_mutex_);
+					sleepers_.fetch_add(1);
+					wake_.wait_for(lock, std::chrono::milliseconds(1), [&]
+					{
+						return generation_.load() != seen_generation || stop_.load();
+					});
+					sleepers_.fetch_sub(1);
+				}
+				if (stop_.load()) return;
+				seen_generation = generation_.load(std::memory_order_acquire);
+				work(slot, seen_generation);
+			}
+		}
+
+	public:
+		/// @brief Creates the pool and spawns its workers
+		/// @param n_threads the number of worker threads to spawn in addition to the thread calling run()
+		explicit gf_thread_pool(const int n_threads = static_cast<int>(std::thread::hardware_concurrency()) - 1)
+		{
+			const int threads = std::max(n_threads, 0);
+			n_slots_ = threads + 1;
+			ranges_ = std::make_unique<chunk_range[]>(n_slots_);
+			threads_.reserve(threads);
+			for (int i = 0; i < threads; ++i)
+			{
+				threads_.emplace_back(&gf_thread_pool::worker_loop, this, i + 1);
+			}
+		}
+
+		gf_thread_pool(const gf_thread_pool&) = delete;
+		gf_thread_pool& operator=(const gf_thread_pool&) = delete;
+
+		~gf_thread_pool()
+		{
+			stop_.store(true);
+			wake_.notify_all();
+			for (auto& thread : threads_)
+			{
+				thread.join();
+			}
+		}
+
+		[[nodiscard]] int threads() const
+		{
+			return n_slots_;
+		}
+
+		/// @brief Runs task over [0, n_items) in chunks of chunk_size and waits for it to finish.
+		/// Only one thread may call run() on a pool at a time.
+		/// @param task function called with the context and a half open item range
+		/// @param context user data passed to the task
+		/// @param n_items number of items to process
+		/// @param chunk_size number of items in each unit of work, at most 2^24 chunks are supported
+		void run(const task_func task, void* context, const int n_items, const int chunk_size)
+		{
+			if (n_items <= 0) return;
+			const int chunk = std::max(chunk_size, 1);
+			const int n_chunks = (n_items + chunk - 1) / chunk;
+			if (n_slots_ == 1 || n_chunks == 1)
+			{
+				task(context, 0, n_items);
+				return;
+			}
+
+			task_ = task;
+			context_ = context;
+			n_items_ = n_items;
+			chunk_size_ = chunk;
+			remaining_chunks_.store(n_chunks, std::memory_order_relaxed);
+			const auto generation = generation_.load(std::memory_order_relaxed) + 1;
+			for (int s = 0; s < n_slots_; ++s)
+			{
+				const auto begin = static_cast<int>(static_cast<long long>(n_chunks) * s / n_slots_);
+				const auto end = static_cast<int>(static_cast<long long>(n_chunks) * (s + 1) / n_slots_);
+				ranges_[s].state.store(pack(generation, begin, end), std::memory_order_release);
+			}
+			generation_.store(generation);
+			if (sleepers_.load() > 0) wake_.notify_all();
+
+			// Only chunks that were claimed need to be waited on, a sleeping worker never holds up the caller
+			work(0, generation);
+			while (remaining_chunks_.load(std::memory_order_acquire) > 0)
+			{
+				std::this_thread::yield();
+			}
+		}
+	};
+}
@@ -3,22 +3,53 @@
 #pragma intrinsic(fabs)
 #pragma intrinsic(floor)
 #include "gfEnvelopes.h"
+#include "gfRandom.h"
+#include "gfSimd.h"
 
 namespace Grainflow
 {
+	/// @brief The transitions gf_utils::find_transitions looks for between neighbouring samples
+	enum class gf_transition
+	{
+		// A grain clock wrapping around or leaving zero, threshold is the level a clock counts as running
+		clock_reset = 0,
+		// The next sample is more than threshold above the last, such as a grain state going from 0 to 1
+		rise = 1,
+	};
+
+	/// @brief The transitions found in a block, first and last are -1 when there were none
+	struct gf_transitions
+	{
+		int first = -1;
+		int last = -1;
+		int count = 0;
+	};
+
 	class gf_utils
 	{
 	private:
 
 	public:
+		static inline float deviate(gf_rng& rng, const float center, const float range)
+		{
+			return center + (rng.uniform() - 0.5f) * 2 * range;
+		}
+
+		static inline float random_range(gf_rng& rng, const float bottom, const float top)
+		{
+			return lerp(bottom, top, rng.uniform());
+		}
+
+		/// @brief Draws from the calling thread's generator, for use with the param_func callbacks
 		static inline float deviate(const float center, const float range, [[maybe_unused]] float empty = 0)
 		{
-			return center + (static_cast<float>(rand() % 10000) * 0.0001f - 0.5f) * 2 * range;
+			return deviate(gf_rng::local(), center, range);
 		}
 
+		/// @brief Draws from the calling thread's generator, for use with the param_func callbacks
 		static inline float random_range(const float bottom, const float top, [[maybe_unused]] float empty = 0)
 		{
-			return lerp(bottom, top, rand() % 10000 * 0.0001f);
+			return random_range(gf_rng::local(), bottom, top);
 		}
 
 		static inline float lerp(const float lower, const float upper, const float position)
@@ -46,6 +77,28 @@ namespace Grainflow
 			return pitch_to_rate(pitch_offset) - 1;
 		}
 
+		/// @brief Floor through an integer truncation. Unlike std::floor this vectorizes without relaxed math
+		/// flags. Only valid for values that fit in a 64 bit integer.
+		template <typename T = double>
+		static inline T fast_floor(const T a)
+		{
+			const auto truncated = static_cast<T>(static_cast<long long>(a));
+			return truncated - static_cast<T>(truncated > a);
+		}
+
+		/// @brief True when every value of a block equals the first. Counts mismatches instead of exiting early so the
+		/// check vectorizes.
+		template <typename T = double>
+		static inline bool is_constant(const T* values, const int size)
+		{
+			int changes = 0;
+			for (int i = 1; i < size; i++)
+			{
+				changes += values[i] != values[0];
+			}
+			return changes == 0;
+		}
+
 		template <typename T = double>
 		static inline T mod(const T a, const T b = 1)
 		{
@@ -96,31 +149,120 @@ namespace Grainflow
 				((n + 0.25) * 4095) % 4096];
 		}
 
-		static inline double cubic_hermite(double a, double b, double c, double d, float t)
+		/// @brief 4 point, 3rd order Hermite between b and c, a and d are the frames either side. t is in [0, 1].
+		template <typename T>
+		static inline T cubic_hermite(const T a, const T b, const T c, const T d, const T t)
 		{
-			double A = -a / 2.0f + (3.0f * b) / 2.0f - (3.0f * c) / 2.0f + d / 2.0f;
-			double B = a - (5.0f * b) / 2.0f + 2.0f * c - d / 2.0f;
-			double C = -a / 2.0f + c / 2.0f;
-			double D = b;
+			const T c1 = (c - a) * static_cast<T>(0.5);
+			const T c2 = a - b * static_cast<T>(2.5) + (c + c) - d * static_cast<T>(0.5);
+			const T c3 = (d - a) * static_cast<T>(0.5) + (b - c) * static_cast<T>(1.5);
+			return ((c3 * t + c2) * t + c1) * t + b;
+		}
 
-			return A * t * t * t + B * t * t + C * t + D;
+		/// @brief Scalar reference for find_transitions over the samples [begin, end)
+		template <gf_transition Kind, typename T>
+		static gf_transitions find_transitions_reference(const T* __restrict input, const T previous,
+		                                                 const T threshold, T* __restrict state, const int begin,
+		                                                 const int end)
+		{
+			gf_transitions result;
+			for (int i = begin; i < end; ++i)
+			{
+				const T last = i > 0 ? input[i - 1] : previous;
+				const T current = input[i];
+				bool cross;
+				if constexpr (Kind == gf_transition::clock_reset)
+				{
+					// The first sample compares the clock carried over from the last block with < instead of <=
+					const bool leaves_zero = i > 0 ? last <= threshold : last < threshold;
+					cross = (last > current && current >= threshold) || (leaves_zero && current > threshold);
+					if (state != nullptr) state[i] = !cross && current >= threshold;
+				}
+				else
+				{
+					cross = last - current < -threshold;
+				}
+				if (!cross) continue;
+				result.first = result.first < 0 ? i : result.first;
+				result.last = i;
+				++result.count;
+				if constexpr (Kind == gf_transition::rise) return result;
+			}
+			return result;
 		}
 
-		template <typename Sigtype = double>
-		static int detect_one_transition(const Sigtype* __restrict input_stream, const int block_size,
-		                                 Sigtype* __restrict last_sample, const int channel)
+		/// @brief Finds transitions between neighbouring samples of a block in one vector pass, previous is the last
+		/// sample of the block before. For clock_reset a non null state receives 1 where the clock runs without
+		/// resetting and 0 elsewhere. rise stops at the first transition and does not write state.
+		template <gf_transition Kind, typename T>
+		static gf_transitions find_transitions(const T* __restrict input, const T previous, const T threshold,
+		                                       T* __restrict state, const int size)
 		{
-			if (last_sample[channel] - input_stream[0] < -0.5f)
+			if (size < 1) return {};
+			// The first sample is checked on its own so the vector loop only reads inside the block
+			auto result = find_transitions_reference<Kind>(input, previous, threshold, state, 0, 1);
+			if constexpr (Kind == gf_transition::rise)
 			{
-				last_sample[channel] = input_stream[block_size - 1];
-				return 0;
+				if (result.count > 0) return result;
 			}
-			last_sample[channel] = input_stream[block_size - 1];
-			for (int i = 1; i < block_size; ++i)
+			int i = 1;
+			if constexpr (gf_simd<T>::enabled)
 			{
-				if (input_stream[i - 1] - input_stream[i] < -0.5f) return i;
+				using simd = gf_simd<T>;
+				const auto v_threshold = simd::set1(threshold);
+				const auto v_negative = simd::set1(-threshold);
+				const auto one = simd::set1(1);
+				for (; i + simd::width <= size; i += simd::width)
+				{
+					const auto last = simd::load(input + i - 1);
+					const auto current = simd::load(input + i);
+					typename simd::reg cross;
+					if constexpr (Kind == gf_transition::clock_reset)
+					{
+						const auto running = simd::cmp_ge(current, v_threshold);
+						cross = simd::bit_or(simd::bit_and(simd::cmp_gt(last, current), running),
+						                     simd::bit_and(simd::cmp_le(last, v_threshold),
+						                                   simd::cmp_gt(current, v_threshold)));
+						if (state != nullptr)
+						{
+							simd::store(state + i, simd::bit_and(simd::bit_andnot(cross, running), one));
+						}
+					}
+					else
+					{
+						cross = simd::cmp_lt(simd::sub(last, current), v_negative);
+					}
+					auto bits = static_cast<unsigned>(simd::mask(cross));
+					for (int lane = 0; bits != 0; bits >>= 1, ++lane)
+					{
+						if ((bits & 1u) == 0) continue;
+						result.first = result.first < 0 ? i + lane : result.first;
+						result.last = i + lane;
+						++result.count;
+						if constexpr (Kind == gf_transition::rise) return result;
+					}
+				}
 			}
-			return block_size;
+			const auto tail = find_transitions_reference<Kind>(input, previous, threshold, state, i, size);
+			if (tail.count > 0)
+			{
+				result.first = result.first < 0 ? tail.first : result.first;
+				result.last = tail.last;
+				result.count += tail.count;
+			}
+			return result;
+		}
+
+		/// @return the first sample where a grain state row rises, block_size when it does not
+		template <typename Sigtype = double>
+		static int detect_one_transition(const Sigtype* __restrict input_stream, const int block_size,
+		                                 Sigtype* __restrict last_sample, const int channel)
+		{
+			const auto previous = last_sample[channel];
+			last_sample[channel] = input_stream[block_size - 1];
+			const auto rise = find_transitions<gf_transition::rise, Sigtype>(
+				input_stream, previous, static_cast<Sigtype>(0.5), nullptr, block_size);
+			return rise.count > 0 ? rise.first : block_size;
 		}
 	};
 
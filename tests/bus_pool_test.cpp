@@ -0,0 +1,124 @@
+// Copyright 2024 The Chris Poovey. All rights reserved.
+// Use of this source code is governed by the MIT License found in the License.md file.
+
+// Checks that bus outputs processed through a pool without workers match processing without a pool bit for bit.
+// Such a pool runs every chunk in one call, so a collection that assumed one chunk per call summed every grain into
+// the first chunk's buses and added stale sums from the other chunks.
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "gfGrainCollection.h"
+#include "gfGenericBufferReader.h"
+
+namespace
+{
+	using namespace Grainflow;
+	using collection = gf_grain_collection<gf_buffer<double>, 64, double>;
+
+	constexpr int grains = 40;
+	constexpr int grains_per_chunk = 4;
+	constexpr int block_size = 64;
+	constexpr int bus_chans = 3;
+	constexpr int blocks = 200;
+
+	struct rig
+	{
+		std::vector<std::vector<double>> inputs;
+		std::vector<std::vector<double>> buses;
+		std::vector<double*> input_rows;
+		std::vector<double*> bus_rows;
+		gf_io_config<double> io_config;
+		double clock = 0;
+
+		rig() : inputs(4, std::vector<double>(block_size)), buses(bus_chans, std::vector<double>(block_size))
+		{
+			for (auto& row : inputs) input_rows.push_back(row.data());
+			for (auto& row : buses) bus_rows.push_back(row.data());
+			io_config.block_size = block_size;
+			io_config.samplerate = 48000;
+			io_config.grain_clock = &input_rows[0];
+			io_config.traversal_phasor = &input_rows[1];
+			io_config.fm = &input_rows[2];
+			io_config.am = &input_rows[3];
+			io_config.grain_clock_chans = io_config.traversal_phasor_chans = io_config.fm_chans = io_config.am_chans =
+				1;
+			io_config.bus_output = bus_rows.data();
+			io_config.bus_chans = bus_chans;
+			io_config.grain_rows = false;
+		}
+
+		void fill(const int block)
+		{
+			for (int i = 0; i < block_size; ++i)
+			{
+				clock += 10.0 / 48000;
+				clock -= std::floor(clock);
+				inputs[0][i] = clock;
+				inputs[1][i] = 0.3 + 0.0001 * block;
+				inputs[2][i] = 0.5 * std::sin(0.001 * (block * block_size + i));
+				inputs[3][i] = 0;
+			}
+		}
+	};
+
+	void setup(collection& grain_collection, gf_buffer<double>* buffer)
+	{
+		grain_collection.set_buffer(gf_buffers::buffer, buffer, 0);
+		grain_collection.param_set(0, "rateRandom", 0.5f);
+		grain_collection.param_set(0, "density", 0.7f);
+		grain_collection.stream_set(gf_stream_set_type::per_streams, bus_chans);
+		grain_collection.seed(42);
+	}
+
+	/// @brief Renders the bus outputs, switching to the pool after a few blocks so stale chunk sums are left behind
+	std::vector<double> render(gf_buffer<double>* buffer, gf_thread_pool* thread_pool)
+	{
+		collection grain_collection(gf_buffer_reader<double>::get_gf_buffer_reader(), grains);
+		setup(grain_collection, buffer);
+		grain_collection.set_thread_pool(nullptr, grains_per_chunk);
+		grain_collection.prepare_bus(bus_chans, block_size);
+		rig test_rig;
+		std::vector<double> result;
+		for (int block = 0; block < blocks; ++block)
+		{
+			if (block == 20) grain_collection.set_thread_pool(thread_pool, grains_per_chunk);
+			test_rig.fill(block);
+			grain_collection.process(test_rig.io_config);
+			for (const auto& bus : test_rig.buses)
+			{
+				result.insert(result.end(), bus.begin(), bus.end());
+			}
+		}
+		return result;
+	}
+}
+
+int main()
+{
+	gf_buffer<double> buffer(48000, 1, 48000);
+	for (int i = 0; i < 48000; ++i)
+	{
+		buffer.channel(0)[i] = std::sin(i * 0.01);
+	}
+	buffer.update_guards();
+
+	gf_thread_pool thread_pool(0);
+	const auto expected = render(&buffer, nullptr);
+	const auto pooled = render(&buffer, &thread_pool);
+	double energy = 0;
+	int mismatches = 0;
+	for (size_t i = 0; i < expected.size(); ++i)
+	{
+		energy += expected[i] * expected[i];
+		mismatches += expected[i] != pooled[i];
+	}
+	if (energy == 0 || mismatches > 0)
+	{
+		std::printf("bus_pool_test failed: %d of %zu samples differ, energy %f\n", mismatches, expected.size(),
+		            energy);
+		return 1;
+	}
+	std::printf("bus_pool_test passed\n");
+	return 0;
+}